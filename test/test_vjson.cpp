@@ -214,6 +214,1145 @@ R"JSON({
 	EXPECT_FALSE( doc.HasKey( "bogus_key" ) );
 }
 
+#if VJSON_HAVE_CPP14
+
+// JSON literal parsed by the compiler.  Most of the checks are static_asserts.
+VJSON_LITERAL( kLiteral, R"JSON({
+	"port": 9090, // Comments are OK in literals
+	"ratio": 1.25,
+	"neg_double_exponent": -123e-45,
+	"string_escaped_characters": "tab\tand\nnewline",
+	"true": true,
+	"false": false,
+	"null": null,
+	"hosts": [ "alpha", "beta", ],
+	"nested": { "inner": { "value": 7 } },
+})JSON" );
+static_assert( kLiteral.IntAtKey( "port", 0 ) == 9090, "" );
+static_assert( kLiteral.DoubleAtKey( "ratio", 0.0 ) == 1.25, "" );
+static_assert( kLiteral.BoolAtKey( "true", false ), "" );
+static_assert( !kLiteral.BoolAtKey( "false", true ), "" );
+static_assert( kLiteral.AtKey( "null" ).IsNull(), "" );
+static_assert( kLiteral.AtKey( "bogus_key" ).IsNull(), "" );
+static_assert( kLiteral.ArrayAtKeyOrEmpty( "hosts" ).ArraySize() == 2, "" );
+static_assert( kLiteral.ArrayAtKeyOrEmpty( "port" ).IsArray(), "" );
+static_assert( kLiteral.ArrayAtKeyOrEmpty( "port" ).ArraySize() == 0, "" );
+static_assert( kLiteral.ObjectAtKeyOrEmpty( "nested" ).ObjectAtKeyOrEmpty( "inner" ).IntAtKey( "value", 0 ) == 7, "" );
+static_assert( kLiteral.IntAtKey( vjson::Key( "port", 4 ), 0 ) == 9090, "" );
+static_assert( !kLiteral.HasKey( vjson::Key( "por", 3 ) ), "" );
+
+TEST(Literal, Basic) {
+	EXPECT_EQ( kLiteral.ObjectSize(), 9 );
+	EXPECT_DOUBLE_EQ( kLiteral.DoubleAtKey( "neg_double_exponent", 0.0 ), -123e-45 );
+	EXPECT_EQ( kLiteral.StringAtKey( "string_escaped_characters", "" ), "tab\tand\nnewline" );
+	EXPECT_STREQ( kLiteral.ArrayAtKeyOrEmpty( "hosts" ).CStringAtIndex( 1, "" ), "beta" );
+
+	std::string hosts;
+	for ( vjson::LiteralValue v: kLiteral.ArrayAtKeyOrEmpty( "hosts" ) )
+		hosts += v.AsCString( "" );
+	EXPECT_EQ( hosts, "alphabeta" );
+	hosts.clear();
+	for ( std::string s: kLiteral.ArrayAtKeyOrEmpty( "hosts" ).Iter<std::string>() )
+		hosts += s;
+	EXPECT_EQ( hosts, "alphabeta" );
+
+	// Convert to a regular DOM
+	vjson::Value doc = kLiteral.ToValue();
+	ASSERT_TRUE( doc.IsObject() );
+	EXPECT_EQ( doc.ObjectSize(), kLiteral.ObjectSize() );
+	EXPECT_EQ( doc.IntAtKey( "port", 0 ), 9090 );
+	EXPECT_EQ( doc.ObjectAtKeyOrEmpty( "nested" ).ObjectAtKeyOrEmpty( "inner" ).IntAtKey( "value", 0 ), 7 );
+}
+
+#endif // #if VJSON_HAVE_CPP14
+
+// Resource limits in ParseContext. Each one should fail with a different error
+TEST(Parse, Limits) {
+	const char *doc = R"JSON({ "a": [ 1, 2, { "b": [ [ [] ] ] } ], "s": "a string that is a bit long" })JSON";
+
+	vjson::Value val;
+	vjson::ParseContext ctx;
+	EXPECT_TRUE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseOK );
+
+	ctx = vjson::ParseContext{}; ctx.max_input_bytes = 10;
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseInputTooLarge );
+	EXPECT_TRUE( val.IsNull() );
+
+	ctx = vjson::ParseContext{}; ctx.max_nodes = 5;
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseTooManyNodes );
+
+	ctx = vjson::ParseContext{}; ctx.max_string_length = 10;
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseStringTooLong );
+
+	ctx = vjson::ParseContext{}; ctx.max_alloc_bytes = 100;
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseAllocBudget );
+
+	ctx = vjson::ParseContext{}; ctx.max_depth = 5;
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseTooDeep );
+	ctx.max_depth = 6;
+	EXPECT_TRUE( val.ParseJSON( doc, &ctx ) );
+
+	ctx = vjson::ParseContext{}; ctx.deadline = std::chrono::steady_clock::now() - std::chrono::seconds( 1 );
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseDeadline );
+
+	std::atomic<bool> cancel{ true };
+	ctx = vjson::ParseContext{}; ctx.cancel = &cancel;
+	EXPECT_FALSE( val.ParseJSON( doc, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseCancelled );
+
+	ctx = vjson::ParseContext{};
+	EXPECT_FALSE( val.ParseJSON( "[ 1, 2", &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseSyntaxError );
+
+	vjson::Object obj;
+	EXPECT_FALSE( obj.ParseJSON( "[ 1, 2 ]", &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseWrongType );
+}
+
+// Objects big enough to need a hash index, when VJSON_FLAT_OBJECT is set
+TEST(Object, ManyKeys) {
+	vjson::Object obj;
+	for ( int i = 0 ; i < 100 ; ++i )
+		obj[ "key" + std::to_string( i ) ] = i;
+	obj[ "key7" ] = 700; // Replace, not add
+	EXPECT_EQ( obj.ObjectSize(), 100 );
+	EXPECT_EQ( obj.IntAtKey( "key7", -1 ), 700 );
+	EXPECT_EQ( obj.IntAtKey( std::string( "key99" ), -1 ), 99 );
+	EXPECT_FALSE( obj.HasKey( "key100" ) );
+
+	for ( int i = 0 ; i < 100 ; i += 2 )
+		EXPECT_EQ( obj.EraseAtKey( "key" + std::to_string( i ) ), vjson::kOK );
+	EXPECT_EQ( obj.EraseAtKey( "key0" ), vjson::kBadKey );
+	EXPECT_EQ( obj.ObjectSize(), 50 );
+	for ( int i = 0 ; i < 100 ; ++i )
+		EXPECT_EQ( obj.IntAtKey( "key" + std::to_string( i ), -1 ), i == 7 ? 700 : i % 2 ? i : -1 );
+
+	// Shrink back down to small, and copy
+	for ( int i = 1 ; i < 95 ; i += 2 )
+		obj.EraseAtKey( "key" + std::to_string( i ) );
+	vjson::Object copy = obj;
+	EXPECT_EQ( copy.ObjectSize(), 3 );
+	EXPECT_EQ( copy.IntAtKey( "key97", -1 ), 97 );
+	EXPECT_FALSE( copy.HasKey( "key93" ) );
+}
+
+// Assigning a value from somewhere inside itself
+TEST(Value, AssignFromChild) {
+	vjson::Value v;
+	ASSERT_TRUE( v.ParseJSON( R"JSON([ [ [ "deep", { "k": [ 1, 2 ] } ], 5 ], "x" ])JSON" ) );
+	v = v.AtIndex( 0 ).AtIndex( 0 ); // Array from a grandchild array, assigned in place otherwise
+	EXPECT_EQ( v.ArraySize(), 2 );
+	EXPECT_STREQ( v.CStringAtIndex( 0, "" ), "deep" );
+	v = v.AtIndex( 1 ).AtKey( "k" );
+	EXPECT_EQ( v.ArraySize(), 2 );
+	EXPECT_EQ( v.IntAtIndex( 1, 0 ), 2 );
+
+	vjson::Value o;
+	ASSERT_TRUE( o.ParseJSON( R"JSON({ "a": { "b": { "c": "a string long enough to not be inline" } } })JSON" ) );
+	o = std::move( *o.ObjectPtrAtKey( "a" )->ValuePtrAtKey( "b" ) );
+	EXPECT_EQ( o.StringAtKey( "c", "" ), "a string long enough to not be inline" );
+	o = o.AtKey( "c" );
+	EXPECT_EQ( o.AsString( "" ), "a string long enough to not be inline" );
+
+	// Same type, but not inside us, still assigns in place
+	vjson::Value a, b;
+	ASSERT_TRUE( a.ParseJSON( "[1,2,3]" ) );
+	ASSERT_TRUE( b.ParseJSON( "[4,5]" ) );
+	a = b;
+	EXPECT_EQ( a.ArraySize(), 2 );
+	EXPECT_EQ( b.ArraySize(), 2 );
+}
+
+// Copies are independent. (With VJSON_COPY_ON_WRITE, they share storage until modified.)
+TEST(Value, Copy) {
+	vjson::Value orig;
+	ASSERT_TRUE( orig.ParseJSON( R"JSON({ "a": { "b": [ 1, 2 ], "c": "a string long enough to not be inline" }, "d": [ {} ] })JSON" ) );
+	vjson::Value copy = orig;
+	#if VJSON_COPY_ON_WRITE
+		EXPECT_EQ( orig.ObjectAtKeyOrEmpty( "a" ).CStringAtKey( "c", "" ), copy.ObjectAtKeyOrEmpty( "a" ).CStringAtKey( "c", "" ) );
+	#endif
+
+	// Change something deep in the copy
+	copy.ObjectPtrAtKey( "a" )->ArrayPtrAtKey( "b" )->push_back( 3 );
+	EXPECT_EQ( copy.ObjectAtKeyOrEmpty( "a" ).ArrayAtKeyOrEmpty( "b" ).ArraySize(), 3 );
+	EXPECT_EQ( orig.ObjectAtKeyOrEmpty( "a" ).ArrayAtKeyOrEmpty( "b" ).ArraySize(), 2 );
+	#if VJSON_COPY_ON_WRITE
+		// Only the path down to the change was copied
+		EXPECT_EQ( orig.ObjectAtKeyOrEmpty( "a" ).CStringAtKey( "c", "" ), copy.ObjectAtKeyOrEmpty( "a" ).CStringAtKey( "c", "" ) );
+		EXPECT_EQ( &orig.ArrayAtKeyOrEmpty( "d" )[0], &copy.ArrayAtKeyOrEmpty( "d" )[0] );
+	#endif
+
+	// Assignment, including from our own child
+	orig = copy;
+	EXPECT_EQ( orig.ObjectAtKeyOrEmpty( "a" ).ArrayAtKeyOrEmpty( "b" ).IntAtIndex( 2, 0 ), 3 );
+	orig = orig.AtKey( "a" );
+	EXPECT_EQ( orig.StringAtKey( "c", "" ), "a string long enough to not be inline" );
+	copy = std::move( copy.GetObject()[ "d" ] );
+	EXPECT_EQ( copy.ArraySize(), 1 );
+}
+
+// A moved-from Object or Array is still a usable, empty Object or Array
+TEST(Value, Move) {
+	vjson::Object a;
+	a[ "x" ] = 1;
+	vjson::Object b( std::move( a ) );
+	EXPECT_TRUE( a.IsObject() );
+	EXPECT_EQ( a.size(), 0 );
+	a[ "y" ] = 2;
+	EXPECT_EQ( a.size(), 1 );
+	EXPECT_EQ( b.size(), 1 );
+	EXPECT_FALSE( b.HasKey( "y" ) );
+	b = std::move( a );
+	EXPECT_TRUE( a.IsObject() );
+	EXPECT_EQ( a.size(), 0 );
+	EXPECT_EQ( b.IntAtKey( "y", 0 ), 2 );
+
+	vjson::Array c;
+	c.push_back( 1 );
+	vjson::Array d( std::move( c ) );
+	EXPECT_TRUE( c.IsArray() );
+	EXPECT_TRUE( c.empty() );
+	c.push_back( 2 );
+	c.push_back( 3 );
+	EXPECT_EQ( c.size(), 2 );
+	EXPECT_EQ( d.size(), 1 );
+	d = std::move( c );
+	EXPECT_TRUE( c.IsArray() );
+	EXPECT_TRUE( c.empty() );
+	EXPECT_EQ( d.IntAtIndex( 1, 0 ), 3 );
+}
+
+// Minified and pretty printing
+TEST(Print, Basic) {
+	vjson::Value doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "a": [ 1, [ 2.5 ], {} ], "b": "x\ny\t\"z\"" })JSON" ) );
+	vjson::PrintOptions minified;
+	minified.indent = "";
+	EXPECT_EQ( doc.PrintJSON( minified ), R"JSON({"a":[1,[2.5],{}],"b":"x\ny\t\"z\""})JSON" );
+	EXPECT_EQ( doc.PrintJSON(), "{\n\t\"a\": [\n\t\t1,\n\t\t[\n\t\t\t2.5\n\t\t],\n\t\t{}\n\t],\n\t\"b\": \"x\\ny\\t\\\"z\\\"\"\n}" );
+
+	// Output that was already right
+	EXPECT_EQ( vjson::Value( 3 ).PrintJSON(), "3" );
+	EXPECT_EQ( vjson::Value( "q\"\\" ).PrintJSON(), R"JSON("q\"\\")JSON" );
+	ASSERT_TRUE( doc.ParseJSON( R"JSON([ 1, true, null, "s" ])JSON" ) );
+	EXPECT_EQ( doc.PrintJSON( minified ), R"JSON([1,true,null,"s"])JSON" );
+
+	// Nested objects keep the pretty separator and indent each level once
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "x": { "y": { "z": [ 0 ] } } })JSON" ) );
+	EXPECT_EQ( doc.PrintJSON( minified ), R"JSON({"x":{"y":{"z":[0]}}})JSON" );
+	EXPECT_EQ( doc.PrintJSON(), "{\n\t\"x\": {\n\t\t\"y\": {\n\t\t\t\"z\": [\n\t\t\t\t0\n\t\t\t]\n\t\t}\n\t}\n}" );
+	vjson::PrintOptions spaces;
+	spaces.indent = "  ";
+	EXPECT_EQ( doc.PrintJSON( spaces ), "{\n  \"x\": {\n    \"y\": {\n      \"z\": [\n        0\n      ]\n    }\n  }\n}" );
+
+	// Control characters use the short escapes, or \u00XX
+	vjson::Value ctl( std::string( "\b\f\r\x01", 4 ) );
+	EXPECT_EQ( ctl.PrintJSON(), R"JSON("\b\f\r\u0001")JSON" );
+}
+
+// Tear down and copy big documents
+TEST(Value, DestroyAndClone) {
+	// Deep enough that recursive destruction might overflow the stack
+	vjson::Value deep;
+	vjson::Value *leaf = &deep;
+	for ( int i = 0 ; i < 200000 ; ++i )
+	{
+		leaf->SetEmptyArray();
+		vjson::Array &arr = leaf->GetArray();
+		arr.push_back( i );
+		leaf = &arr.push_back();
+	}
+	vjson::Value deep_clone = deep.Clone(); // Also without recursion
+	size_t depth = 0;
+	for ( const vjson::Value *v = &deep_clone ; v->IsArray() ; v = &v->AtIndex( 1 ) )
+	{
+		EXPECT_EQ( v->IntAtIndex( 0, -1 ), (int)depth );
+		++depth;
+	}
+	EXPECT_EQ( depth, 200000 );
+	deep_clone.Destroy();
+	deep.Destroy();
+	EXPECT_TRUE( deep.IsArray() );
+	EXPECT_EQ( deep.ArraySize(), 0 );
+
+	// Through a typed reference, the type doesn't change
+	vjson::Value obj;
+	ASSERT_TRUE( obj.ParseJSON( R"JSON({ "a": [ { "b": 1 } ] })JSON" ) );
+	vjson::Object &o = obj.GetObject();
+	o.Destroy();
+	EXPECT_TRUE( obj.IsObject() );
+	EXPECT_EQ( o.ObjectSize(), 0 );
+	o[ "c" ] = 2;
+	EXPECT_EQ( obj.IntAtKey( "c", 0 ), 2 );
+	vjson::Value str( "string" );
+	str.Destroy();
+	EXPECT_TRUE( str.IsNull() );
+
+	vjson::Value doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "a": { "b": [ 1, "two", null, [ {} ] ] }, "c": true })JSON" ) );
+	vjson::Value clone = doc.Clone();
+	EXPECT_EQ( clone.PrintJSON(), doc.PrintJSON() );
+	EXPECT_TRUE( clone.AtKey( "c" ).AsBool( false ) );
+	const vjson::Value &b = clone.AtKey( "a" ).AtKey( "b" );
+	ASSERT_EQ( b.ArraySize(), 4u );
+	EXPECT_EQ( b.AtIndex( 0 ).AsInt( 0 ), 1 );
+	EXPECT_STREQ( b.AtIndex( 1 ).AsCString( "" ), "two" );
+	EXPECT_TRUE( b.AtIndex( 2 ).IsNull() );
+	EXPECT_EQ( b.AtIndex( 3 ).AtIndex( 0 ).ObjectSize(), 0u );
+	EXPECT_NE( &clone.AtKey( "a" ).AtKey( "b" ).AtIndex( 1 ).GetString(), &doc.AtKey( "a" ).AtKey( "b" ).AtIndex( 1 ).GetString() );
+
+	// Destroy on a background thread
+	vjson::Reclaimer reclaimer;
+	reclaimer.Reclaim( std::move( doc ) );
+	EXPECT_TRUE( doc.IsObject() );
+	EXPECT_EQ( doc.ObjectSize(), 0 );
+	vjson::Array &arr = clone.GetObject()[ "a" ].GetObject()[ "b" ].GetArray();
+	reclaimer.Reclaim( std::move( arr ) );
+	EXPECT_TRUE( clone.AtKey( "a" ).AtKey( "b" ).IsArray() );
+	arr.push_back( 1 );
+	EXPECT_EQ( arr.ArraySize(), 1 );
+	reclaimer.Reclaim( std::move( clone ) );
+	reclaimer.Flush();
+	reclaimer.Reclaim( vjson::Value( "last" ) );
+}
+
+#if VJSON_HAVE_CPP14
+
+// Read-only documents, built at runtime
+TEST(Frozen, Basic) {
+	vjson::FrozenDocument frozen;
+	ASSERT_TRUE( frozen.ParseJSON( R"JSON({ "port": 8080, "hosts": [ "alpha", "beta" ], "debug": false, "extra": { "x": null } })JSON" ) );
+	vjson::LiteralValue root = frozen.Root();
+	EXPECT_EQ( root.IntAtKey( "port", 0 ), 8080 );
+	EXPECT_EQ( root.ArrayAtKeyOrEmpty( "hosts" ).ArraySize(), 2 );
+	EXPECT_STREQ( root.ArrayAtKeyOrEmpty( "hosts" ).CStringAtIndex( 1, "" ), "beta" );
+	EXPECT_FALSE( root.BoolAtKey( "debug", true ) );
+	EXPECT_TRUE( root.ObjectAtKeyOrEmpty( "extra" ).AtKey( "x" ).IsNull() );
+	EXPECT_TRUE( root.ObjectAtKeyOrEmpty( "extra" ).HasKey( "x" ) );
+	EXPECT_EQ( root.ObjectAtKeyOrEmpty( "bogus" ).ObjectSize(), 0 );
+
+	// Freeze a Value, and thaw it out again
+	vjson::Object obj;
+	obj[ "a" ] = "a string long enough to not be inline";
+	obj[ "b" ] = frozen.Root().ToValue();
+	vjson::FrozenDocument frozen2( obj );
+	EXPECT_EQ( frozen2.Root().StringAtKey( "a", "" ), "a string long enough to not be inline" );
+	EXPECT_EQ( frozen2.Root().ObjectAtKeyOrEmpty( "b" ).IntAtKey( "port", 0 ), 8080 );
+	vjson::Value thawed = frozen2.Root().ToValue();
+	EXPECT_EQ( thawed.PrintJSON(), obj.PrintJSON() );
+
+	// A stored key with a null in it is longer than a C string can be
+	vjson::Object nul;
+	nul[ std::string( "a\0bcdefghijklmnop", 17 ) ] = 1;
+	vjson::FrozenDocument frozen3( nul );
+	std::vector<char> a { 'a', '\0' }; // On the heap, so ASan sees an overrun
+	EXPECT_EQ( frozen3.Root().IntAtKey( a.data(), 0 ), 0 );
+	EXPECT_EQ( frozen3.Root().IntAtKey( vjson::Key( "a\0bcdefghijklmnop", 17 ), 0 ), 1 );
+
+	// Lookup in a big object is a binary search, whether frozen from a Value
+	// or parsed directly
+	vjson::Object big;
+	for ( int i = 0 ; i < 1000 ; ++i )
+		big[ "key" + std::to_string( i ) ] = i;
+	big[ "k" ] = -1;
+	vjson::FrozenDocument frozen4( big ), frozen5;
+	ASSERT_TRUE( frozen5.ParseJSON( big.PrintJSON() ) );
+	for ( const vjson::FrozenDocument *f: { &frozen4, &frozen5 } )
+	{
+		EXPECT_EQ( f->Root().ObjectSize(), 1001 );
+		EXPECT_EQ( f->Root().IntAtKey( "key0", -2 ), 0 );
+		EXPECT_EQ( f->Root().IntAtKey( "key999", -2 ), 999 );
+		EXPECT_EQ( f->Root().IntAtKey( vjson::Key( "key500", 6 ), -2 ), 500 );
+		EXPECT_EQ( f->Root().IntAtKey( "k", -2 ), -1 );
+		EXPECT_FALSE( f->Root().HasKey( "key" ) );
+		EXPECT_FALSE( f->Root().HasKey( "key1000" ) );
+	}
+
+	// Duplicate keys: the last one wins, like Value
+	vjson::FrozenDocument dups;
+	ASSERT_TRUE( dups.ParseJSON( R"JSON({ "a": 1, "b": { "x": [ 1, 2 ] }, "a": 2, "c": 3, "b": "last" })JSON" ) );
+	EXPECT_EQ( dups.Root().ObjectSize(), 3 );
+	EXPECT_EQ( dups.Root().IntAtKey( "a", 0 ), 2 );
+	EXPECT_EQ( dups.Root().StringAtKey( "b", "" ), "last" );
+	EXPECT_EQ( dups.Root().IntAtKey( "c", 0 ), 3 );
+	std::string keys;
+	for ( vjson::LiteralMember item: dups.Root().Members() )
+		keys += item.first;
+	EXPECT_EQ( keys, "acb" );
+
+	// Typed iteration
+	vjson::FrozenDocument mixed;
+	ASSERT_TRUE( mixed.ParseJSON( R"JSON([ 1, "two", 3.5, { "x": 4 }, [ 5 ], true, null ])JSON" ) );
+	double sum = 0.0;
+	for ( double x: mixed.Root().Iter<double>() )
+		sum += x;
+	EXPECT_EQ( sum, 4.5 );
+	std::string strings;
+	for ( const char *x: mixed.Root().Iter<const char *>() )
+		strings += x;
+	EXPECT_EQ( strings, "two" );
+	int objects = 0;
+	for ( vjson::LiteralValue x: mixed.Root().Iter<vjson::Object>() )
+		objects += x.IntAtKey( "x", 0 );
+	EXPECT_EQ( objects, 4 );
+	for ( vjson::LiteralValue x: mixed.Root().Iter<vjson::Array>() )
+		EXPECT_EQ( x.IntAtIndex( 0, 0 ), 5 );
+	for ( bool x: mixed.Root().Iter<bool>() )
+		EXPECT_TRUE( x );
+	for ( int x: mixed.Root().AtIndex( 0 ).Iter<int>() ) // Not an array
+		EXPECT_TRUE( false ) << x;
+
+	// Failure
+	EXPECT_FALSE( frozen.ParseJSON( "[ 1, " ) );
+	EXPECT_TRUE( frozen.Root().IsNull() );
+}
+
+#endif // #if VJSON_HAVE_CPP14
+
+// Read numeric arrays without copying
+TEST(Array, Numbers) {
+	vjson::Value doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "nums": [ 1, 2.5, -3 ], "bools": [ true, false ], "mixed": [ 1, "2" ], "empty": [] })JSON" ) );
+	vjson::StridedSpan<double> nums = doc.ArrayAtKeyOrEmpty( "nums" ).Numbers();
+	ASSERT_EQ( nums.size(), 3 );
+	EXPECT_EQ( nums[1], 2.5 );
+	EXPECT_EQ( &nums[1], &doc.ArrayAtKeyOrEmpty( "nums" )[1].GetDouble() );
+	double total = 0.0;
+	for ( double x: nums )
+		total += x;
+	EXPECT_EQ( total, 0.5 );
+
+	vjson::StridedSpan<bool> bools = doc.ArrayAtKeyOrEmpty( "bools" ).Bools();
+	ASSERT_EQ( bools.size(), 2 );
+	EXPECT_TRUE( bools[0] );
+	EXPECT_FALSE( bools[1] );
+
+	EXPECT_TRUE( doc.ArrayAtKeyOrEmpty( "mixed" ).Numbers().empty() );
+	EXPECT_TRUE( doc.ArrayAtKeyOrEmpty( "empty" ).Numbers().empty() );
+	EXPECT_TRUE( doc.ArrayAtKeyOrEmpty( "nums" ).Bools().empty() );
+}
+
+// Aggregation kernels
+TEST(Array, Summarize) {
+	vjson::Value doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "mixed": [ 4, "x", -2.5, null, 10, true, 0.5 ], "empty": [],
+		"orders": [ { "price": 3 }, { "price": "7" }, 12, { "qty": 1 }, { "price": 5, "qty": 2 } ] })JSON" ) );
+
+	vjson::NumberStats stats = doc.ArrayAtKeyOrEmpty( "mixed" ).Summarize();
+	EXPECT_EQ( stats.count, 4 );
+	EXPECT_EQ( stats.sum, 12.0 );
+	EXPECT_EQ( stats.min, -2.5 );
+	EXPECT_EQ( stats.max, 10.0 );
+	EXPECT_EQ( stats.mean(), 3.0 );
+
+	stats = doc.ArrayAtKeyOrEmpty( "empty" ).Summarize();
+	EXPECT_EQ( stats.count, 0 );
+	EXPECT_EQ( stats.min, 0.0 );
+	EXPECT_EQ( stats.mean(), 0.0 );
+
+	using namespace vjson::literals;
+	const vjson::Array &orders = doc.ArrayAtKeyOrEmpty( "orders" );
+	stats = orders.SummarizeAtKey( "price"_vk );
+	EXPECT_EQ( stats.count, 2 );
+	EXPECT_EQ( stats.sum, 8.0 );
+	EXPECT_EQ( stats.max, 5.0 );
+	EXPECT_EQ( orders.SummarizeAtKey( "qty" ).sum, 3.0 );
+	EXPECT_EQ( orders.HistogramAtKey( "price", 0, 10, 2 ), std::vector<size_t>( { 1, 1 } ) );
+
+	// Big enough for several blocks and an uneven tail.  Every 7th element isn't a number
+	vjson::Array arr;
+	double sum = 0.0, lo = 1e9, hi = -1e9;
+	size_t count = 0;
+	for ( int i = 0 ; i < 1003 ; ++i )
+	{
+		if ( i % 7 == 3 )
+		{
+			arr.push_back( "skip" );
+			continue;
+		}
+		double x = ( i * 37 ) % 101 - 50;
+		arr.push_back( x );
+		sum += x; lo = std::min( lo, x ); hi = std::max( hi, x ); ++count;
+	}
+	stats = arr.Summarize();
+	EXPECT_EQ( stats.count, count );
+	EXPECT_EQ( stats.sum, sum ); // Small integers, so the order doesn't matter
+	EXPECT_EQ( stats.min, lo );
+	EXPECT_EQ( stats.max, hi );
+
+	std::vector<size_t> hist = arr.Histogram( -50, 50, 10 );
+	ASSERT_EQ( hist.size(), 10 );
+	size_t in_range = 0, expect_first = 0;
+	for ( const vjson::Value &x: arr )
+	{
+		if ( x.IsNumber() && x.AsDouble( 0.0 ) < 50 )
+			++in_range;
+		if ( x.IsNumber() && x.AsDouble( 0.0 ) < -40 )
+			++expect_first;
+	}
+	size_t total = 0;
+	for ( size_t c: hist )
+		total += c;
+	EXPECT_EQ( total, in_range ); // 50 is outside [ -50, 50 )
+	EXPECT_EQ( hist[0], expect_first );
+	EXPECT_TRUE( arr.Histogram( 1, 1, 4 ) == std::vector<size_t>( 4 ) );
+	EXPECT_TRUE( arr.Histogram( 0, 1, 0 ).empty() );
+}
+
+// Lookups with interned keys
+TEST(Object, InternedKeys) {
+	vjson::KeyTable table;
+	vjson::Key name = table.Intern( "name" );
+	EXPECT_EQ( table.Intern( std::string( "name" ) ).c_str(), name.c_str() );
+	EXPECT_EQ( table.Intern( "namespace", 4 ).c_str(), name.c_str() );
+	EXPECT_EQ( table.size(), 1 );
+
+	vjson::Object obj;
+	obj[ "name" ] = "bob";
+	obj[ "age" ] = 42;
+	EXPECT_TRUE( obj.HasKey( name ) );
+	EXPECT_EQ( obj.StringAtKey( name, "" ), "bob" );
+	EXPECT_EQ( obj.IntAtKey( table.Intern( "age" ), 0 ), 42 );
+	EXPECT_EQ( obj.InterpretAsStringAtKey( table.Intern( "age" ), "" ), "42" );
+	EXPECT_FALSE( obj.HasKey( table.Intern( "nam" ) ) );
+	EXPECT_EQ( table.size(), 3 );
+
+	// Big objects, and keys that are not interned
+	for ( int i = 0 ; i < 50 ; ++i )
+		obj[ "key" + std::to_string( i ) ] = i;
+	EXPECT_EQ( obj.StringAtKey( name, "" ), "bob" );
+	EXPECT_EQ( obj.IntAtKey( vjson::Key( "key33" ), -1 ), 33 );
+	EXPECT_EQ( obj.IntAtKey( vjson::Key( "key333", 5 ), -1 ), 33 );
+}
+
+// Keys with the length and hash worked out at compile time
+TEST(Object, KeyLiterals) {
+	using namespace vjson::literals;
+	#if VJSON_HAVE_CPP14
+		static constexpr vjson::Key kUser = "user"_vk;
+		static_assert( kUser.length() == 4, "Wrong length" );
+		static_assert( kUser.hash == vjson::HashKey( "user", 4 ), "Wrong hash" );
+	#else
+		static const vjson::Key kUser = "user"_vk;
+	#endif
+
+	vjson::Object obj;
+	ASSERT_TRUE( obj.ParseJSON( R"JSON({ "user": "bob", "id": 7 })JSON" ) );
+	EXPECT_EQ( obj.StringAtKey( kUser, "" ), "bob" );
+	EXPECT_EQ( obj.IntAtKey( "id"_vk, 0 ), 7 );
+	EXPECT_FALSE( obj.HasKey( "use"_vk ) );
+	#if VJSON_HAVE_CPP14
+		EXPECT_EQ( kLiteral.StringAtKey( "string_escaped_characters"_vk, "" ), "tab\tand\nnewline" );
+	#endif
+}
+
+// Keys that aren't null-terminated strings
+TEST(Object, KeyTypes) {
+	vjson::Object obj;
+	obj.SetAtKey( vjson::Key( "key" ), 1 );
+	obj[ std::string( "a\0b", 3 ) ] = 2;
+	obj[ std::string( "a\0c", 3 ) ] = 3;
+	EXPECT_EQ( obj.size(), 3 );
+	EXPECT_EQ( obj.IntAtKey( std::string( "a\0c", 3 ), 0 ), 3 );
+	EXPECT_EQ( obj.IntAtKey( vjson::Key( "a\0b", 3 ), 0 ), 2 );
+	EXPECT_FALSE( obj.HasKey( "a" ) ); // Only a prefix of "a\0b", up to the null
+	obj[ "a" ] = 1;
+	EXPECT_EQ( obj.IntAtKey( "a", 0 ), 1 );
+	EXPECT_EQ( obj.IntAtKey( std::string( "a\0b", 3 ), 0 ), 2 );
+	EXPECT_EQ( obj.EraseAtKey( "a" ), vjson::kOK );
+	EXPECT_EQ( obj.size(), 3 );
+	EXPECT_EQ( obj.EraseAtKey( vjson::Key( "key" ) ), vjson::kOK );
+	EXPECT_EQ( obj.EraseAtKey( "key" ), vjson::kBadKey );
+
+	#if VJSON_HAVE_CPP17
+		std::string_view buf = "namevalue";
+		obj[ buf.substr( 0, 4 ) ] = "bob";
+		EXPECT_TRUE( obj.HasKey( buf.substr( 0, 4 ) ) );
+		EXPECT_FALSE( obj.HasKey( buf.substr( 0, 3 ) ) );
+		EXPECT_EQ( obj.StringViewAtKey( buf.substr( 0, 4 ), "" ), "bob" );
+		EXPECT_EQ( obj.StringViewAtKey( buf.substr( 4 ), "none" ), "none" );
+		EXPECT_EQ( obj.AtKey( buf.substr( 0, 4 ) ).AsStringView( "" ), "bob" );
+		EXPECT_EQ( obj.SetAtKey( buf.substr( 4 ), 5 ), vjson::kOK );
+		EXPECT_EQ( obj.IntAtKey( "value", 0 ), 5 );
+		EXPECT_EQ( obj.EraseAtKey( buf.substr( 4 ) ), vjson::kOK );
+		EXPECT_FALSE( obj.HasKey( "value" ) );
+
+		vjson::Array arr;
+		arr.ParseJSON( R"JSON([ "x", 1 ])JSON" );
+		EXPECT_EQ( arr.StringViewAtIndex( 0, "" ), "x" );
+		EXPECT_EQ( arr.StringViewAtIndex( 1, "?" ), "?" );
+	#endif
+}
+
+// Looking up the same key in many objects of the same shape
+TEST(Object, CachedKeys) {
+	vjson::Array records;
+	ASSERT_TRUE( records.ParseJSON( R"JSON([
+		{ "id": 1, "name": "a", "score": 10 },
+		{ "id": 2, "name": "b", "score": 20 },
+		{ "score": 30, "id": 3 },
+		{ "id": 4, "name": "d" }
+	])JSON" ) );
+	const vjson::CachedKey score( "score" ), name( "name" );
+	int total = 0;
+	for ( const vjson::Value &r: records )
+		total += r.IntAtKey( score, 0 );
+	EXPECT_EQ( total, 60 );
+	EXPECT_EQ( records.AtIndex( 1 ).StringAtKey( name, "" ), "b" );
+	EXPECT_FALSE( records.AtIndex( 2 ).HasKey( name ) );
+	EXPECT_EQ( records.AtIndex( 3 ).StringAtKey( name, "" ), "d" );
+	EXPECT_EQ( records.AtIndex( 3 ).ValuePtrAtKey( score ), nullptr );
+	EXPECT_EQ( vjson::Value( 5 ).ValuePtrAtKey( score ), nullptr );
+}
+
+// Read-only objects with perfect hash lookup
+TEST(Object, Freeze) {
+	vjson::Object obj;
+	for ( int i = 0 ; i < 1000 ; ++i )
+		obj[ "/route/" + std::to_string( i ) ] = i;
+	vjson::FrozenObject routes = obj.Freeze();
+	EXPECT_TRUE( obj.empty() );
+	EXPECT_EQ( routes.size(), 1000 );
+	for ( int i = 0 ; i < 1000 ; ++i )
+		ASSERT_EQ( routes.AtKey( "/route/" + std::to_string( i ) ).AsInt( -1 ), i );
+	EXPECT_FALSE( routes.HasKey( "/route/1000" ) );
+	EXPECT_FALSE( routes.HasKey( "" ) );
+	EXPECT_TRUE( routes.HasKey( vjson::Key( "/route/77" ) ) );
+	EXPECT_TRUE( routes.AtKey( "bogus" ).IsNull() );
+
+	// Tiny and empty objects
+	vjson::Object one;
+	one[ "a" ] = "x";
+	EXPECT_EQ( vjson::FrozenObject( one ).AtKey( "a" ).AsString( "" ), "x" );
+	EXPECT_EQ( one.size(), 1 ); // Copied, not moved
+	EXPECT_EQ( vjson::FrozenObject().ValuePtrAtKey( "a" ), nullptr );
+
+	// Typed access
+	vjson::Value config;
+	ASSERT_TRUE( config.ParseJSON( R"JSON({ "name": "svc", "port": 8080, "ratio": 0.5, "tls": true, "hosts": [ "a", "b" ], "limits": { "rps": 100 } })JSON" ) );
+	vjson::FrozenObject frozen( config.GetObject() );
+	EXPECT_STREQ( frozen.CStringAtKey( "name", "" ), "svc" );
+	EXPECT_EQ( frozen.StringAtKey( vjson::Key( "name" ), "" ), "svc" );
+	EXPECT_EQ( frozen.StringAtKey( "port", std::string( "none" ) ), "none" );
+	EXPECT_EQ( frozen.IntAtKey( "port", 0 ), 8080 );
+	EXPECT_EQ( frozen.IntAtKey( "bogus", 80 ), 80 );
+	EXPECT_EQ( frozen.DoubleAtKey( "ratio", 0.0 ), 0.5 );
+	EXPECT_TRUE( frozen.BoolAtKey( "tls", false ) );
+	EXPECT_FALSE( frozen.BoolAtKey( "port", false ) ); // Strict type
+	EXPECT_EQ( frozen.ArrayAtKeyOrEmpty( "hosts" ).ArraySize(), 2 );
+	EXPECT_EQ( frozen.ArrayAtKeyOrEmpty( "limits" ).ArraySize(), 0 );
+	EXPECT_EQ( frozen.ObjectAtKeyOrEmpty( "limits" ).IntAtKey( "rps", 0 ), 100 );
+	EXPECT_EQ( frozen.ObjectAtKeyOrEmpty( "bogus" ).size(), 0 );
+	EXPECT_NE( frozen.ObjectPtrAtKey( "limits" ), nullptr );
+	EXPECT_EQ( frozen.ArrayPtrAtKey( "limits" ), nullptr );
+
+	// Thaw it to make changes
+	obj = routes.Thaw();
+	EXPECT_TRUE( routes.empty() );
+	EXPECT_EQ( obj.size(), 1000 );
+	EXPECT_EQ( obj.IntAtKey( "/route/500", -1 ), 500 );
+}
+
+// Building documents in place
+TEST(Object, Builders) {
+	vjson::Object resp;
+	vjson::ObjectBuilder b( resp );
+	b.Reserve( 4 );
+	b.Emplace( "id", 42 );
+	std::string name = "a string long enough to not be stored inline";
+	const char *chars = name.c_str();
+	b.Emplace( "name", std::move( name ) );
+	b.Emplace( std::string( "ok" ), true );
+	b.Emplace( "id", 43 ); // Replaces
+	vjson::ArrayBuilder tags = b.EmplaceArray( "tags" );
+	tags.Reserve( 3 );
+	tags.Emplace( "x" );
+	tags.Emplace( 1.5 );
+	tags.EmplaceObject().Emplace( "deep", "y" );
+	EXPECT_EQ( resp.size(), 4 );
+	EXPECT_EQ( resp.IntAtKey( "id", 0 ), 43 );
+	EXPECT_EQ( resp.CStringAtKey( "name", nullptr ), chars ); // Moved, not copied
+	EXPECT_TRUE( resp.BoolAtKey( "ok", false ) );
+	EXPECT_EQ( resp.ArrayAtKeyOrEmpty( "tags" ).ArraySize(), 3 );
+	EXPECT_EQ( resp.ArrayAtKeyOrEmpty( "tags" ).AtIndex( 2 ).StringAtKey( "deep", "" ), "y" );
+
+	// Keys in sorted order
+	vjson::Value v( 5 );
+	vjson::ObjectBuilder sorted( v );
+	ASSERT_TRUE( v.IsObject() );
+	for ( int i = 0 ; i < 20 ; ++i )
+	{
+		char key[ 16 ];
+		snprintf( key, sizeof(key), "k%02d", i );
+		sorted.EmplaceSorted( key, i );
+	}
+	EXPECT_EQ( v.ObjectSize(), 20 );
+	EXPECT_EQ( v.IntAtKey( "k13", -1 ), 13 );
+	sorted.Emplace( "k13", vjson::kNull );
+	EXPECT_TRUE( v.AtKey( "k13" ).IsNull() );
+	EXPECT_EQ( v.ObjectSize(), 20 );
+}
+
+// Parallel algorithms
+TEST(Array, Parallel) {
+	vjson::ThreadPool pool( 4 ), serial( 0 );
+	EXPECT_EQ( pool.size(), 4 );
+	vjson::Array arr;
+	for ( int i = 0 ; i < 100000 ; ++i )
+		arr.push_back( i * 0.1 );
+
+	// Same result no matter how many threads
+	auto get = []( const vjson::Value &x ) { return x.AsDouble( 0.0 ); };
+	double total = vjson::ParallelReduce( pool, arr, 0.0, get, std::plus<double>(), 100 );
+	EXPECT_EQ( total, vjson::ParallelReduce( serial, arr, 0.0, get, std::plus<double>(), 100 ) );
+	EXPECT_NEAR( total, 0.1 * 99999.0 * 100000.0 / 2, 1e-3 );
+
+	vjson::ParallelForEach( pool, arr, []( vjson::Value &x ) { x = x.AsDouble( 0.0 ) * 2; }, 100 );
+	EXPECT_DOUBLE_EQ( arr.AtIndex( 500 ).AsDouble( 0.0 ), 100.0 );
+
+	vjson::Array strings;
+	vjson::ParallelTransform( pool, arr, strings, []( const vjson::Value &x ) { return std::to_string( (int)x.AsDouble( 0.0 ) ); }, 100 );
+	EXPECT_EQ( strings.size(), arr.size() );
+	EXPECT_EQ( strings.StringAtIndex( 500, "" ), "100" );
+	vjson::ParallelTransform( pool, strings, []( const vjson::Value &x ) { return (int)x.AsString( "" ).length(); } );
+	EXPECT_EQ( strings.IntAtIndex( 500, 0 ), 3 );
+
+	// Nested
+	std::atomic<size_t> count{0};
+	pool.ParallelFor( 64, 1, [&]( size_t b, size_t e )
+	{
+		for ( size_t i = b ; i < e ; ++i )
+			pool.ParallelFor( 1000, 10, [&]( size_t b2, size_t e2 ) { count += e2 - b2; } );
+	} );
+	EXPECT_EQ( count, 64000 );
+
+	// Object members
+	vjson::Object obj;
+	for ( int i = 0 ; i < 5000 ; ++i )
+		obj[ "key" + std::to_string( i ) ] = i;
+	vjson::ParallelForEach( pool, obj, []( vjson::ObjectItem &item ) { item.second = item.second.AsInt( 0 ) + 1; }, 64 );
+	long sum = vjson::ParallelReduce( pool, (const vjson::Object &)obj, 0L, []( const vjson::ObjectItem &item ) { return (long)item.second.AsInt( 0 ); }, std::plus<long>(), 64 );
+	EXPECT_EQ( sum, 5000L * 5001 / 2 );
+	bool all = vjson::ParallelReduce( pool, arr, true, []( const vjson::Value &x ) { return x.IsNumber(); }, []( bool a, bool b ) { return a && b; } );
+	EXPECT_TRUE( all );
+}
+
+// Memory accounting
+TEST(Value, MemoryUsage) {
+	EXPECT_EQ( vjson::Value( 5 ).MemoryUsage().total(), sizeof(vjson::Value) );
+
+	vjson::Value doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "a key long enough to not be stored inline": "a string long enough to not be stored inline", "list": [ 1, 2, 3 ] })JSON" ) );
+	vjson::MemoryStats m = doc.MemoryUsage();
+	EXPECT_EQ( m.values, 6*sizeof(vjson::Value) );
+	EXPECT_EQ( m.keys, 42 );
+	EXPECT_EQ( m.strings, 45 );
+	EXPECT_GT( m.overhead, 0 );
+
+	// Grow the array, which leaves slack, and then get it back
+	vjson::Array &list = *doc.ArrayPtrAtKey( "list" );
+	list.push_back( 4 );
+	list.push_back( 5 );
+	vjson::MemoryStats before = doc.MemoryUsage();
+	EXPECT_GE( before.slack, ( list.Raw().capacity() - 5 ) * sizeof(vjson::Value) );
+	doc.Compact();
+	vjson::MemoryStats after = doc.MemoryUsage();
+	EXPECT_EQ( list.Raw().capacity(), 5 );
+	EXPECT_LT( after.slack, before.slack );
+	EXPECT_EQ( after.values, before.values );
+	EXPECT_EQ( doc.AtKey( "list" ).IntAtIndex( 4, 0 ), 5 );
+
+	// Deep documents don't recurse
+	vjson::Value deep;
+	vjson::Value *leaf = &deep;
+	for ( int i = 0 ; i < 100000 ; ++i )
+	{
+		leaf->SetEmptyArray();
+		leaf = &leaf->AsArrayPtr()->push_back();
+	}
+	EXPECT_EQ( deep.MemoryUsage().values, 100001*sizeof(vjson::Value) );
+	deep.Compact();
+	deep.Destroy();
+}
+
+// Moving subtrees between documents
+TEST(Object, ExtractAndSplice) {
+	vjson::Object req, resp;
+	ASSERT_TRUE( req.ParseJSON( R"JSON({ "user": { "name": "a string long enough to not be inline", "id": 7 }, "items": [ 1, 2, 3, 4, 5 ] })JSON" ) );
+	const char *chars = req.AtKey( "user" ).CStringAtKey( "name", nullptr );
+
+	vjson::ObjectNode node = req.Extract( "user" );
+	ASSERT_FALSE( node.empty() );
+	EXPECT_EQ( node.key(), "user" );
+	EXPECT_FALSE( req.HasKey( "user" ) );
+	EXPECT_FALSE( req.Extract( "user" ) );
+	vjson::Value *user = resp.Insert( std::move( node ) );
+	ASSERT_NE( user, nullptr );
+	EXPECT_EQ( user->CStringAtKey( "name", nullptr ), chars ); // Moved, not copied
+	EXPECT_EQ( resp.AtKey( "user" ).IntAtKey( "id", 0 ), 7 );
+	EXPECT_EQ( resp.Insert( vjson::ObjectNode() ), nullptr );
+
+	// Replacing an existing member
+	vjson::Object other;
+	other[ "user" ] = 5;
+	resp.Insert( other.Extract( "user" ) );
+	EXPECT_EQ( resp.IntAtKey( "user", 0 ), 5 );
+	EXPECT_EQ( resp.size(), 1 );
+
+	vjson::Array out;
+	vjson::Array &items = *req.ArrayPtrAtKey( "items" );
+	EXPECT_EQ( items.Splice( 1, 3, out ), 2 );
+	EXPECT_EQ( items.Splice( 2, 100, out ), 1 );
+	EXPECT_EQ( items.Splice( 5, 6, out ), 0 );
+	EXPECT_EQ( items.size(), 2 );
+	EXPECT_EQ( out.size(), 3 );
+	EXPECT_EQ( out.IntAtIndex( 0, 0 ), 2 );
+	EXPECT_EQ( out.IntAtIndex( 2, 0 ), 5 );
+	EXPECT_EQ( items.IntAtIndex( 1, 0 ), 4 );
+}
+
+// Looking up many keys at once
+TEST(Object, KeySets) {
+	static const vjson::KeySet kKeys{ "port", "host", "tls", "missing", "host" };
+	vjson::Object obj;
+	ASSERT_TRUE( obj.ParseJSON( R"JSON({ "a": 1, "host": "example.com", "port": 8080, "tls": "yes", "z": [] })JSON" ) );
+	const vjson::Value *ptrs[7];
+	EXPECT_EQ( obj.ValuePtrsAtKeys( kKeys, ptrs ), 4 );
+	EXPECT_EQ( ptrs[0], obj.ValuePtrAtKey( "port" ) );
+	EXPECT_EQ( ptrs[1], obj.ValuePtrAtKey( "host" ) );
+	EXPECT_EQ( ptrs[3], nullptr );
+	EXPECT_EQ( ptrs[4], ptrs[1] );
+
+	int port = 80; std::string host = "localhost"; bool tls = false; const char *missing = "none"; const char *host2 = nullptr;
+	EXPECT_EQ( obj.GetAtKeys( kKeys, port, host, tls, missing, host2 ), 3 ); // "tls" is the wrong type
+	EXPECT_EQ( port, 8080 );
+	EXPECT_EQ( host, "example.com" );
+	EXPECT_FALSE( tls );
+	EXPECT_STREQ( missing, "none" );
+	EXPECT_STREQ( host2, "example.com" );
+
+	#if VJSON_HAVE_CPP14
+		auto t = obj.TupleAtKeys( vjson::KeySet{ "z", "a" }, (const vjson::Array *)nullptr, 0.0 );
+		ASSERT_NE( std::get<0>( t ), nullptr );
+		EXPECT_EQ( std::get<1>( t ), 1.0 );
+	#endif
+	EXPECT_EQ( vjson::Value( 5 ).ValuePtrsAtKeys( kKeys, ptrs ), 0 );
+	EXPECT_EQ( ptrs[1], nullptr );
+
+	// Big object, where separate lookups are cheaper than a walk
+	for ( int i = 0 ; i < 1000 ; ++i )
+		obj[ "key" + std::to_string( i ) ] = i;
+	port = 0;
+	EXPECT_EQ( obj.GetAtKeys( vjson::KeySet{ "port", "key999" }, port, tls ), 1 );
+	EXPECT_EQ( port, 8080 );
+	EXPECT_EQ( obj.ValuePtrsAtKeys( vjson::KeySet{ "key5", "key999", "key0", "port", "host", "tls", "nope" }, ptrs ), 6 );
+}
+
+// JSON Pointer lookups
+TEST(Object, Paths) {
+	vjson::Object doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({
+		"config": { "limits": { "rate": { "burst": 25 } }, "hosts": [ { "name": "alpha" }, { "name": "beta" } ] },
+		"a/b": 1, "m~n": 2, "": 3, "10": "ten"
+	})JSON" ) );
+
+	const vjson::Path kBurst( "/config/limits/rate/burst" );
+	EXPECT_EQ( doc.IntAtPath( kBurst, 0 ), 25 );
+	EXPECT_EQ( doc.StringAtPath( vjson::Path( "/config/hosts/1/name" ), "" ), "beta" );
+	EXPECT_EQ( doc.ObjectAtPathOrEmpty( vjson::Path( "/config/limits" ) ).ObjectSize(), 1 );
+	EXPECT_EQ( doc.ArrayAtPathOrEmpty( vjson::Path( "/config/hosts" ) ).ArraySize(), 2 );
+	EXPECT_EQ( &doc.AtPath( vjson::Path( "" ) ), &doc );
+
+	// Escapes, and keys that look like indices
+	EXPECT_EQ( doc.IntAtPath( vjson::Path( "/a~1b" ), 0 ), 1 );
+	EXPECT_EQ( doc.IntAtPath( vjson::Path( "/m~0n" ), 0 ), 2 );
+	EXPECT_EQ( doc.IntAtPath( vjson::Path( "/" ), 0 ), 3 );
+	EXPECT_EQ( doc.StringAtPath( vjson::Path( "/10" ), "" ), "ten" );
+
+	// Missing, wrong type, malformed
+	int x = -1;
+	EXPECT_EQ( doc.TryInterpretAtPath( vjson::Path( "/config/limits/nope/burst" ), x ), vjson::kBadKey );
+	EXPECT_EQ( doc.TryInterpretAtPath( vjson::Path( "/config/hosts/2" ), x ), vjson::kBadIndex );
+	EXPECT_EQ( doc.TryInterpretAtPath( vjson::Path( "/config/hosts/01" ), x ), vjson::kBadIndex );
+	EXPECT_EQ( doc.TryInterpretAtPath( vjson::Path( "/config/limits/rate/burst/x" ), x ), vjson::kNotObject );
+	EXPECT_EQ( doc.TryInterpretAtPath( vjson::Path( "/config/limits/rate/burst/0" ), x ), vjson::kNotArray );
+	EXPECT_EQ( x, -1 );
+	EXPECT_EQ( doc.TryInterpretAtPath( kBurst, x ), vjson::kOK );
+	EXPECT_EQ( x, 25 );
+	EXPECT_FALSE( vjson::Path( "config" ).IsValid() );
+	EXPECT_FALSE( vjson::Path( "/a~2" ).IsValid() );
+	EXPECT_EQ( doc.ValuePtrAtPath( vjson::Path( "config" ) ), nullptr );
+
+	// Modify through a path
+	*doc.ValuePtrAtPath( kBurst ) = 50;
+	EXPECT_EQ( doc.IntAtPath( kBurst, 0 ), 50 );
+
+	// Cached lookups
+	vjson::Document d;
+	ASSERT_TRUE( d.ParseJSON( R"JSON({ "a": { "b": 1 } })JSON" ) );
+	vjson::CachedPath path( "/a/b" );
+	const vjson::Value *first = path.ValuePtrIn( d );
+	EXPECT_EQ( first->AsInt( 0 ), 1 );
+	EXPECT_EQ( path.ValuePtrIn( d ), first );
+	ASSERT_TRUE( d.ParseJSON( R"JSON({ "a": { "c": 1 } })JSON" ) );
+	EXPECT_TRUE( path.In( d ).IsNull() );
+	d.Root().ObjectPtrAtKey( "a" )->SetAtKey( "b", 2 );
+	EXPECT_EQ( path.In( d ).AsInt( 0 ), 2 );
+
+	// Copies and moves get a new generation, so nothing cached for one
+	// document is mistaken for another's
+	vjson::Document other;
+	ASSERT_TRUE( other.ParseJSON( R"JSON({ "a": { "b": 3 } })JSON" ) );
+	vjson::Document copied( other );
+	EXPECT_NE( copied.Generation(), other.Generation() );
+	EXPECT_EQ( path.In( copied ).AsInt( 0 ), 3 );
+	copied = vjson::Document( other ); // Move-assign. The old storage is freed
+	EXPECT_EQ( path.In( copied ).AsInt( 0 ), 3 );
+	copied = d; // Copy-assign
+	EXPECT_NE( copied.Generation(), d.Generation() );
+	EXPECT_EQ( path.In( copied ).AsInt( 0 ), 2 );
+	{
+		vjson::Document moved( std::move( other ) );
+		EXPECT_EQ( path.In( moved ).AsInt( 0 ), 3 );
+		EXPECT_EQ( path.ValuePtrIn( other ), nullptr ); // Moved-from is null
+		EXPECT_TRUE( other.Root().IsNull() );
+		copied = std::move( moved );
+		EXPECT_EQ( path.ValuePtrIn( moved ), nullptr );
+	}
+	EXPECT_EQ( path.In( copied ).AsInt( 0 ), 3 );
+}
+
+// Finding records by ID
+TEST(Array, Index) {
+	vjson::Value doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "users": [
+		{ "id": 7, "name": "seven" },
+		{ "id": "12", "name": "twelve" },
+		{ "id": "bob", "name": "bob" },
+		{ "name": "no id" },
+		"not an object",
+		{ "id": 1.5, "name": "one and a half" },
+		{ "id": 7, "name": "another seven" },
+		{ "id": { "nested": true } }
+	] })JSON" ) );
+	vjson::Array &users = *doc.ValuePtrAtKey( "users" )->AsArrayPtr();
+
+	vjson::ArrayIndex byId( users, "/id" );
+	EXPECT_EQ( byId.size(), 4 );
+	EXPECT_STREQ( byId.Find( 7 )->CStringAtKey( "name", "" ), "seven" ); // First one wins
+	EXPECT_EQ( byId.Find( "7" ), byId.Find( 7 ) );
+	EXPECT_EQ( byId.IndexOf( 12 ), 1 );
+	EXPECT_EQ( byId.IndexOf( "12" ), 1 );
+	EXPECT_EQ( byId.IndexOf( std::string( "bob" ) ), 2 );
+	EXPECT_EQ( byId.IndexOf( 1.5 ), 5 );
+	EXPECT_EQ( byId.IndexOf( "1.5" ), 5 );
+	EXPECT_EQ( byId.IndexOf( 1 ), vjson::ArrayIndex::npos );
+	EXPECT_EQ( byId.Find( "nobody" ), nullptr );
+	EXPECT_EQ( byId.IndexOf( vjson::Value() ), vjson::ArrayIndex::npos );
+
+	// Appending is picked up
+	users.push_back( vjson::Object() ).SetAtKey( "id", 99 );
+	EXPECT_EQ( byId.IndexOf( "99" ), 8 );
+
+	// Changing an element through operator[] is seen by the array
+	users[0].SetAtKey( "id", "alice" );
+	EXPECT_EQ( byId.IndexOf( 7 ), 6 );
+	EXPECT_EQ( byId.IndexOf( "alice" ), 0 );
+
+	// Changes through a reference from before aren't seen until Update(),
+	// but the stale entry is never returned
+	vjson::Value &second = users[1];
+	EXPECT_EQ( byId.IndexOf( 12 ), 1 );
+	second.SetAtKey( "id", 13 );
+	EXPECT_EQ( byId.IndexOf( 12 ), vjson::ArrayIndex::npos );
+	EXPECT_EQ( byId.IndexOf( 13 ), vjson::ArrayIndex::npos );
+	byId.Update( 1 );
+	EXPECT_EQ( byId.IndexOf( 13 ), 1 );
+
+	// A const index is never modified by a lookup. It still finds elements
+	// appended since it was synced, or after other changes
+	const vjson::ArrayIndex &constById = byId;
+	users.push_back( vjson::Object() ).SetAtKey( "id", "carol" );
+	EXPECT_EQ( constById.IndexOf( "carol" ), 9 );
+	EXPECT_EQ( constById.IndexOf( 13 ), 1 );
+	EXPECT_EQ( constById.IndexOf( "dave" ), vjson::ArrayIndex::npos );
+	users[9].SetAtKey( "id", "dave" );
+	EXPECT_EQ( constById.IndexOf( "dave" ), 9 );
+	EXPECT_EQ( constById.Find( "carol" ), nullptr );
+	byId.Sync();
+	EXPECT_EQ( constById.IndexOf( "dave" ), 9 );
+	vjson::Array dave;
+	users.Splice( 9, 10, dave );
+
+	// Removing elements rebuilds
+	vjson::Array removed;
+	users.Splice( 0, 3, removed );
+	EXPECT_EQ( byId.IndexOf( 7 ), 3 );
+	EXPECT_EQ( byId.IndexOf( "bob" ), vjson::ArrayIndex::npos );
+
+	// Removing and then appending can leave the array the same size
+	vjson::Array tmp;
+	users.Splice( 1, 2, tmp );
+	vjson::Object o;
+	o[ "id" ] = 42;
+	users.push_back( o );
+	EXPECT_EQ( users.size(), 6 );
+	EXPECT_EQ( byId.IndexOf( 42 ), 5 );
+	EXPECT_EQ( byId.IndexOf( 99 ), 4 );
+	EXPECT_EQ( byId.IndexOf( 7 ), 2 );
+	EXPECT_EQ( byId.IndexOf( 1.5 ), 1 );
+	EXPECT_EQ( byId.IndexOf( 12 ), vjson::ArrayIndex::npos );
+	users.clear();
+	EXPECT_EQ( byId.size(), 0 );
+	EXPECT_EQ( byId.Find( 7 ), nullptr );
+
+	// Deeper paths, and lots of records
+	vjson::Array big;
+	for ( int i = 0 ; i < 10000 ; ++i )
+	{
+		vjson::Object meta;
+		meta[ "key" ] = ( i % 2 ) ? vjson::Value( i ) : vjson::Value( std::to_string( i ) );
+		big.push_back( vjson::Object() ).SetAtKey( "meta", std::move( meta ) );
+	}
+	vjson::ArrayIndex byKey( big, vjson::Path( "/meta/key" ) );
+	EXPECT_EQ( byKey.size(), 10000 );
+	for ( int i = 0 ; i < 10000 ; i += 97 )
+	{
+		EXPECT_EQ( byKey.IndexOf( i ), (size_t)i );
+		EXPECT_EQ( byKey.IndexOf( std::to_string( i ) ), (size_t)i );
+	}
+}
+
+// Parse into an existing document, recycling its storage
+TEST(Parse, ReuseStorage) {
+	vjson::ParseContext ctx;
+	ctx.reuse_storage = true;
+	vjson::Object doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "id": "a string long enough to not be inline", "list": [ 1, 2, 3, 4 ], "gone": {} })JSON", &ctx ) );
+	const vjson::Value *list = doc.ValuePtrAtKey( "list" );
+	const vjson::Value *first = list->ValuePtrAtIndex( 0 );
+	const char *id = doc.CStringAtKey( "id", nullptr );
+
+	// Same shape, different values. Storage should be reused
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "list": [ 5, 6 ], "id": "a different string, also not inline", "new": true })JSON", &ctx ) );
+	EXPECT_EQ( doc.ObjectSize(), 3 );
+	#if VJSON_HAVE_CPP17 && !VJSON_FLAT_OBJECT // Map nodes are only recycled with C++17
+		EXPECT_EQ( doc.ValuePtrAtKey( "list" ), list );
+	#endif
+	#if VJSON_HAVE_CPP17 || VJSON_FLAT_OBJECT
+		EXPECT_EQ( doc.ArrayAtKeyOrEmpty( "list" ).ValuePtrAtIndex( 0 ), first );
+		EXPECT_EQ( doc.CStringAtKey( "id", nullptr ), id );
+	#endif
+	(void)list; (void)first; (void)id; // Not used in every configuration
+	EXPECT_EQ( doc.ArrayAtKeyOrEmpty( "list" ).ArraySize(), 2 );
+	EXPECT_EQ( doc.ArrayAtKeyOrEmpty( "list" ).IntAtIndex( 1, 0 ), 6 );
+	EXPECT_EQ( doc.StringAtKey( "id", "" ), "a different string, also not inline" );
+	EXPECT_TRUE( doc.BoolAtKey( "new", false ) );
+	EXPECT_FALSE( doc.HasKey( "gone" ) );
+
+	// Different types at the same keys
+	ASSERT_TRUE( doc.ParseJSON( R"JSON({ "list": "x", "id": [ {} ], "new": true, "new": false })JSON", &ctx ) );
+	EXPECT_EQ( doc.ObjectSize(), 3 );
+	EXPECT_EQ( doc.StringAtKey( "list", "" ), "x" );
+	EXPECT_EQ( doc.ArrayAtKeyOrEmpty( "id" ).ObjectAtIndexOrEmpty( 0 ).ObjectSize(), 0 );
+	EXPECT_FALSE( doc.BoolAtKey( "new", true ) );
+}
+
+// Growing a vector of Values moves them, unless moving the object storage could throw
+static_assert( std::is_nothrow_move_constructible<vjson::Value>::value == ( VJSON_COMPACT_VALUE || std::is_nothrow_move_constructible<vjson::RawObject>::value ), "" );
+static_assert( std::is_nothrow_move_constructible<vjson::Array>::value == !VJSON_COMPACT_VALUE, "" );
+
+// A Document recycles storage across parses
+TEST(Parse, Document) {
+	vjson::Document doc;
+	ASSERT_TRUE( doc.ParseJSON( R"JSON([ "a string long enough to not be inline", 1 ])JSON" ) );
+	const char *str = doc.Root().CStringAtIndex( 0, nullptr );
+	ASSERT_TRUE( str != nullptr );
+	doc.Reset();
+	EXPECT_TRUE( doc.Root().IsNull() );
+
+	ASSERT_TRUE( doc.ParseJSON( R"JSON([ "another string, not inline either", true, "x" ])JSON" ) );
+	EXPECT_EQ( doc.Root().CStringAtIndex( 0, nullptr ), str );
+	EXPECT_EQ( doc.Root().StringAtIndex( 0, "" ), "another string, not inline either" );
+	EXPECT_EQ( doc.Root().ArraySize(), 3 );
+
+	EXPECT_FALSE( doc.ParseJSON( "[ 1, " ) );
+	EXPECT_EQ( doc.ctx.error, vjson::kParseSyntaxError );
+	EXPECT_TRUE( doc.Root().IsNull() );
+
+	doc.Release();
+	ASSERT_TRUE( doc.ParseJSON( "{}" ) );
+	EXPECT_TRUE( doc.Root().IsObject() );
+}
+
+// Statistics about the parse
+TEST(Parse, Stats) {
+	vjson::ParseStats stats;
+	stats.measure_build_time = true;
+	vjson::ParseContext ctx;
+	ctx.stats = &stats;
+	vjson::Value doc;
+	const char *json = R"JSON({ "a": [ 1, 2.5, true, null, "x" ], "b\n": { "c": [ [] ] }, "d": "a string long enough to not be inline" })JSON";
+	ASSERT_TRUE( doc.ParseJSON( json, &ctx ) );
+	EXPECT_EQ( stats.bytes, strlen( json ) );
+	EXPECT_EQ( stats.objects, 2 );
+	EXPECT_EQ( stats.arrays, 3 );
+	EXPECT_EQ( stats.strings, 2 );
+	EXPECT_EQ( stats.numbers, 2 );
+	EXPECT_EQ( stats.bools, 1 );
+	EXPECT_EQ( stats.nulls, 1 );
+	EXPECT_EQ( stats.keys, 4 );
+	EXPECT_EQ( stats.escaped_strings, 1 );
+	EXPECT_EQ( stats.string_bytes, 1 + 2 + 1 + 1 + 1 + 37 );
+	EXPECT_EQ( stats.max_depth, 4 );
+	EXPECT_GE( stats.allocs, 4 + 3 + 1 ); // map nodes, array storage, long string
+	EXPECT_GT( stats.alloc_bytes, 0 );
+	EXPECT_GT( stats.total_time.count(), 0 );
+	EXPECT_LE( stats.build_time, stats.total_time );
+
+	// Reset on each parse
+	ASSERT_FALSE( doc.ParseJSON( "[ 1, ", &ctx ) );
+	EXPECT_EQ( stats.numbers, 1 );
+	EXPECT_EQ( stats.bytes, 5 );
+	EXPECT_TRUE( stats.measure_build_time );
+}
+
+// Parse a memory-mapped file
+TEST(Parse, File) {
+	const char *filename = "test_vjson_parse_file.json";
+	FILE *f = fopen( filename, "wb" );
+	ASSERT_TRUE( f != nullptr );
+	fputs( "{\n\t\"key\": [ 1, 2, 3 ],\n\t\"bad\": tru\n}", f );
+	fclose( f );
+
+	vjson::ParseContext ctx;
+	vjson::Object doc;
+	EXPECT_FALSE( doc.ParseFile( filename, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseSyntaxError );
+	EXPECT_EQ( ctx.error_line, 3 );
+	EXPECT_EQ( ctx.error_byte_offset, 31 );
+
+	f = fopen( filename, "wb" );
+	ASSERT_TRUE( f != nullptr );
+	fputs( "{ \"key\": [ 1, 2, 3 ] }", f );
+	fclose( f );
+	ctx.file_huge_pages = true;
+	EXPECT_TRUE( doc.ParseFile( filename, &ctx ) );
+	EXPECT_EQ( doc.ArrayAtKeyOrEmpty( "key" ).IntAtIndex( 2, 0 ), 3 );
+	remove( filename );
+
+	EXPECT_FALSE( doc.ParseFile( filename, &ctx ) );
+	EXPECT_EQ( ctx.error, vjson::kParseFileError );
+	EXPECT_TRUE( doc.IsObject() );
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
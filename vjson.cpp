@@ -20,6 +20,28 @@
 
 #include <stdarg.h>
 #include <locale.h>
+#include <errno.h>
+#include <algorithm>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX // Or std::min, std::max, and time_point::max() won't compile
+	#endif
+	#include <windows.h>
+	#undef GetObject // wingdi.h makes this GetObjectA, which would rename Value::GetObject in this file only
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
 
 #include "vjson.h"
 
@@ -33,6 +55,19 @@ template <typename T> void InvokeDestructor( T &x ) { x.~T(); }
 template <typename T, typename A> void InvokeConstructor( T &x, A&& a ) { new (&x) T( std::forward<A>( a ) ); }
 template <typename T> void InvokeConstructor( T &x) { new (&x) T{}; }
 
+// With the compact layout, strings and aggregates live on the heap.
+// (These are more specialized, so they win over the ones above.)
+template <typename T> void InvokeDestructor( T *&x ) { delete x; }
+template <typename T, typename A> void InvokeConstructor( T *&x, A&& a ) { x = new T( std::forward<A>( a ) ); }
+template <typename T> void InvokeConstructor( T *&x ) { x = new T{}; }
+#if VJSON_COPY_ON_WRITE
+	template <typename T> void InvokeDestructor( SharedBox<T> *&x ) { ReleaseBox( x ); }
+#endif
+
+#if VJSON_COMPACT_VALUE
+	static_assert( sizeof(Value) <= 16, "Compact Value layout should be 16 bytes" );
+#endif
+
 const Object &GetStaticEmptyObject()
 {
 	static Object dummy;
@@ -52,6 +87,165 @@ const Value &GetStaticNullValue()
 	return dummy;
 }
 
+#if VJSON_FLAT_OBJECT
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// FlatObject
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static inline bool KeyEquals( const std::string &k, const char *key, size_t len )
+{
+	return k.length() == len && memcmp( k.data(), key, len ) == 0;
+}
+
+FlatObject::iterator FlatObject::find( const Key &key )
+{
+	// Small object?  Just scan them all.  Checking the hash
+	// first means we usually don't even touch the key data.
+	if ( _index.empty() )
+	{
+		for ( size_t i = 0 ; i < _hashes.size() ; ++i )
+		{
+			if ( _hashes[i] == key.hash && KeyEquals( _entries[i].first, key.str, key.len ) )
+				return _entries.begin() + i;
+		}
+		return _entries.end();
+	}
+
+	// Probe the hash index
+	size_t mask = _index.size() - 1;
+	for ( size_t slot = key.hash & mask ;; slot = ( slot + 1 ) & mask )
+	{
+		uint32_t e = _index[ slot ];
+		if ( e == 0 )
+			return _entries.end();
+		if ( _hashes[ e-1 ] == key.hash && KeyEquals( _entries[ e-1 ].first, key.str, key.len ) )
+			return _entries.begin() + ( e-1 );
+	}
+}
+
+void FlatObject::IndexEntry( size_t idx )
+{
+	size_t mask = _index.size() - 1;
+	size_t slot = _hashes[ idx ] & mask;
+	while ( _index[ slot ] != 0 )
+		slot = ( slot + 1 ) & mask;
+	_index[ slot ] = uint32_t( idx + 1 );
+}
+
+void FlatObject::Reindex()
+{
+	_index.clear();
+	if ( _entries.size() <= kMaxLinear )
+		return;
+
+	// Keep the load factor at or below 50%
+	size_t slots = 16;
+	while ( slots < _entries.size()*2 )
+		slots *= 2;
+	_index.resize( slots, 0 );
+	for ( size_t i = 0 ; i < _entries.size() ; ++i )
+		IndexEntry( i );
+}
+
+Value &FlatObject::InternalAdd( std::string &&key, uint32_t hash )
+{
+	_entries.emplace_back( std::move( key ), Value() );
+	_hashes.push_back( hash );
+	IndexAdded();
+	return _entries.back().second;
+}
+
+void FlatObject::IndexAdded()
+{
+	size_t n = _entries.size();
+	if ( n > kMaxLinear )
+	{
+		if ( n*2 > _index.size() )
+			Reindex();
+		else
+			IndexEntry( n-1 );
+	}
+}
+
+Value &FlatObject::operator[]( const char *key )
+{
+	Key k( key );
+	iterator it = find( k );
+	if ( it != _entries.end() )
+		return it->second;
+	return InternalAdd( std::string( key, k.len ), k.hash );
+}
+
+Value &FlatObject::operator[]( const std::string &key )
+{
+	Key k( key.c_str(), key.length() );
+	iterator it = find( k );
+	if ( it != _entries.end() )
+		return it->second;
+	return InternalAdd( std::string( key ), k.hash );
+}
+
+Value &FlatObject::operator[]( std::string &&key )
+{
+	Key k( key.c_str(), key.length() );
+	iterator it = find( k );
+	if ( it != _entries.end() )
+		return it->second;
+	return InternalAdd( std::move( key ), k.hash );
+}
+
+FlatObject::iterator FlatObject::erase( const_iterator pos )
+{
+	size_t idx = pos - _entries.cbegin();
+	_entries.erase( _entries.begin() + idx );
+	_hashes.erase( _hashes.begin() + idx );
+	if ( !_index.empty() )
+		Reindex();
+	return _entries.begin() + idx;
+}
+
+size_t FlatObject::erase( const char *key )
+{
+	iterator it = find( key );
+	if ( it == _entries.end() )
+		return 0;
+	erase( it );
+	return 1;
+}
+
+size_t FlatObject::erase( const std::string &key )
+{
+	iterator it = find( key );
+	if ( it == _entries.end() )
+		return 0;
+	erase( it );
+	return 1;
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// KeyTable
+//
+/////////////////////////////////////////////////////////////////////////////
+
+Key KeyTable::Intern( const char *key, size_t len )
+{
+	std::lock_guard<std::mutex> lock( _lock );
+	const std::string &s = *_keys.emplace( key, len ).first;
+	return Key( s.c_str(), s.length() );
+}
+
+size_t KeyTable::size() const
+{
+	std::lock_guard<std::mutex> lock( _lock );
+	return _keys.size();
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // DOM manipulation
@@ -67,71 +261,158 @@ void Value::InternalDestruct()
 	else if ( _type == kString )
 		InvokeDestructor( _string );
 	_type = kDeleted; // Not necessary, but helps to catch bugs
+	++_epoch;
 }
 
 void Value::InternalConstruct( const Value &x )
 {
 	_type = x._type;
-	if ( _type == kObject )
-		InvokeConstructor( _object, x._object );
-	else if ( _type == kArray )
-		InvokeConstructor( _array, x._array );
-	else if ( _type == kString )
-		InvokeConstructor( _string, x._string );
-	else
-		_dummy = x._dummy; // Some other primitive -- just copy 8 bytes
+	#if VJSON_COPY_ON_WRITE
+		// Share the storage. Whoever modifies it first will make a copy
+		_dummy = x._dummy;
+		if ( _type == kObject )
+			_object->refs.fetch_add( 1, std::memory_order_relaxed );
+		else if ( _type == kArray )
+			_array->refs.fetch_add( 1, std::memory_order_relaxed );
+		else if ( _type == kString )
+			_string->refs.fetch_add( 1, std::memory_order_relaxed );
+	#else
+		if ( _type == kObject )
+			InvokeConstructor( _object, x.RawObj() );
+		else if ( _type == kArray )
+			InvokeConstructor( _array, x.RawArr() );
+		else if ( _type == kString )
+			InvokeConstructor( _string, x.RawStr() );
+		else
+			_dummy = x._dummy; // Some other primitive -- just copy 8 bytes
+	#endif
 	static_assert( sizeof(_dummy) >= sizeof(_double), "_dummy must be as big as all primitives" );
 }
 
-void Value::InternalConstruct( Value &&x )
+void Value::InternalConstruct( Value &&x ) VJSON_MOVE_NOEXCEPT
 {
 	_type = x._type;
-	if ( _type == kObject )
-		InvokeConstructor( _object, std::move( x._object ) );
-	else if ( _type == kArray )
-		InvokeConstructor( _array, std::move( x._array ) );
-	else if ( _type == kString )
-		InvokeConstructor( _string, std::move( x._string ) );
-	else
-		_dummy = x._dummy; // Some other primitive -- just copy 8 bytes
+	#if VJSON_COMPACT_VALUE
+		// Just steal the pointer (or primitive value), and leave the other guy null
+		_dummy = x._dummy;
+		x._type = kNull;
+		x._dummy = {};
+		++x._epoch;
+	#else
+		if ( _type == kObject )
+			InvokeConstructor( _object, std::move( x.RawObj() ) );
+		else if ( _type == kArray )
+			InvokeConstructor( _array, std::move( x.RawArr() ) );
+		else if ( _type == kString )
+			InvokeConstructor( _string, std::move( x.RawStr() ) );
+		else
+			_dummy = x._dummy; // Some other primitive -- just copy 8 bytes
+	#endif
 	static_assert( sizeof(_dummy) >= sizeof(_double), "_dummy must be as big as all primitives" );
 }
 
 Value *Value::InternalAtIndex( size_t idx, EValueType t ) const
 {
-	Value *v = (const_cast<Value*>(this))->ValuePtrAtIndex( idx );
+	Value *v = const_cast<Value*>( ValuePtrAtIndex( idx ) );
 	return (v && v->_type == t) ? v : nullptr; 
 }
 
-Value *Value::ValuePtrAtKey( const std::string &key )
+const Value *Value::ValuePtrAtKey( const std::string &key ) const
 {
 	if ( _type != kObject )
 		return nullptr;
-	auto it = _object.find( key );
-	if ( it == _object.end() )
+	auto it = RawObj().find( key );
+	if ( it == RawObj().end() )
 		return nullptr;
 	return &it->second;
 }
 
-Value *Value::ValuePtrAtKey( const char *key )
+const Value *Value::ValuePtrAtKey( const char *key ) const
 {
 	if ( _type != kObject )
 		return nullptr;
-	auto it = _object.find( key ); // NOTE: Before C++14, this makes a copy of the key!!!!  SO BAD!
-	if ( it == _object.end() )
+	auto it = RawObj().find( key ); // NOTE: Before C++14, this makes a copy of the key!!!!  SO BAD!  (Also if the comparator isn't transparent)
+	if ( it == RawObj().end() )
 		return nullptr;
 	return &it->second;
 }
 
+const Value *Value::ValuePtrAtKey( const Key &key ) const
+{
+	if ( _type != kObject )
+		return nullptr;
+	auto it = RawObj().find( KeyToFind( key ) ); // With VJSON_FLAT_OBJECT, uses the precomputed hash
+	if ( it == RawObj().end() )
+		return nullptr;
+	return &it->second;
+}
+
+#if VJSON_HAVE_CPP17
+const Value *Value::ValuePtrAtKey( std::string_view key ) const
+{
+	if ( _type != kObject )
+		return nullptr;
+	auto it = RawObj().find( key );
+	if ( it == RawObj().end() )
+		return nullptr;
+	return &it->second;
+}
+
+Value *Value::InternalAtKey( std::string_view key, EValueType t ) const
+{
+	Value *v = const_cast<Value*>( ValuePtrAtKey( key ) );
+	return (v && v->_type == t) ? v : nullptr; 
+}
+#endif
+
 Value *Value::InternalAtKey( const std::string &key, EValueType t ) const
 {
-	Value *v = (const_cast<Value*>(this))->ValuePtrAtKey( key );
+	Value *v = const_cast<Value*>( ValuePtrAtKey( key ) );
+	return (v && v->_type == t) ? v : nullptr; 
+}
+
+const Value *Value::ValuePtrAtKey( const CachedKey &key ) const
+{
+	#if VJSON_FLAT_OBJECT
+		if ( _type != kObject )
+			return nullptr;
+
+		// Check the member where we found it last time
+		const RawObject &obj = RawObj();
+		uint32_t slot = key._slot.load( std::memory_order_relaxed );
+		if ( slot < obj.size() )
+		{
+			const ObjectItem &item = obj.begin()[ slot ];
+			if ( KeyEquals( item.first, key.str, key.len ) )
+				return &item.second;
+		}
+
+		// Miss.  Search, and remember where we found it
+		auto it = obj.find( static_cast<const Key &>( key ) );
+		if ( it == obj.end() )
+			return nullptr;
+		key._slot.store( uint32_t( it - obj.begin() ), std::memory_order_relaxed );
+		return &it->second;
+	#else
+		return ValuePtrAtKey( static_cast<const Key &>( key ) );
+	#endif
+}
+
+Value *Value::InternalAtKey( const CachedKey &key, EValueType t ) const
+{
+	Value *v = const_cast<Value*>( ValuePtrAtKey( key ) );
+	return (v && v->_type == t) ? v : nullptr; 
+}
+
+Value *Value::InternalAtKey( const Key &key, EValueType t ) const
+{
+	Value *v = const_cast<Value*>( ValuePtrAtKey( key ) );
 	return (v && v->_type == t) ? v : nullptr; 
 }
 
 Value *Value::InternalAtKey( const char *key, EValueType t ) const
 {
-	Value *v = (const_cast<Value*>(this))->ValuePtrAtKey( key );
+	Value *v = const_cast<Value*>( ValuePtrAtKey( key ) );
 	return (v && v->_type == t) ? v : nullptr; 
 }
 
@@ -147,59 +428,97 @@ Value::Value( EValueType type ) : _type( type )
 		_double = 0.0; // Here we assume that double 0.0 representation is all zeros, so that the bool value will be false.
 }
 
-Value::Value( const char *x ) : _type( kString ), _string( x ) {}
-Value::Value( const std::string &x ) : _type( kString ), _string( x ) {}
-Value::Value( std::string &&x ) : _type( kString ), _string( std::forward<std::string>( x ) ) {}
-Value::Value( const RawObject & x ) : _type( kObject ), _object( x ) {}
-Value::Value( RawObject && x ) : _type( kObject ), _object( std::forward<RawObject>( x ) ) {}
-Value::Value( const RawArray & x ) : _type( kArray ), _array( x ) {}
-Value::Value( RawArray && x ) : _type( kArray ), _array( std::forward<RawArray>( x ) ) {}
+Value::Value( const char *x ) : _type( kString ) { InvokeConstructor( _string, x ); }
+Value::Value( const std::string &x ) : _type( kString ) { InvokeConstructor( _string, x ); }
+Value::Value( std::string &&x ) : _type( kString ) { InvokeConstructor( _string, std::forward<std::string>( x ) ); }
+Value::Value( const RawObject & x ) : _type( kObject ) { InvokeConstructor( _object, x ); }
+Value::Value( RawObject && x ) : _type( kObject ) { InvokeConstructor( _object, std::forward<RawObject>( x ) ); }
+Value::Value( const RawArray & x ) : _type( kArray ) { InvokeConstructor( _array, x ); }
+Value::Value( RawArray && x ) : _type( kArray ) { InvokeConstructor( _array, std::forward<RawArray>( x ) ); }
 
-Value &Value::operator=( const Value &x )
+bool Value::InternalContains( const Value &x ) const
 {
-	if ( _type == x._type )
+	// Walk the tree without recursion.  We only need a list for containers
+	// that have children of their own.
+	std::vector<const Value *> pending;
+	const Value *v = this;
+	for (;;)
 	{
-		if ( this != &x )
+		if ( v->_type == kObject )
+		{
+			for ( const ObjectItem &item: v->RawObj() )
+			{
+				const Value &child = item.second;
+				if ( &child == &x )
+					return true;
+				if ( child._type == kObject || child._type == kArray )
+					pending.push_back( &child );
+			}
+		}
+		else if ( v->_type == kArray )
+		{
+			for ( const Value &child: v->RawArr() )
+			{
+				if ( &child == &x )
+					return true;
+				if ( child._type == kObject || child._type == kArray )
+					pending.push_back( &child );
+			}
+		}
+		if ( pending.empty() )
+			return false;
+		v = pending.back();
+		pending.pop_back();
+	}
+}
+
+Value &Value::operator=( const Value &x )
+{
+	if ( this == &x )
+		return *this;
+
+	// Assign in place, reusing our nodes and buffers.  But not if x is
+	// somewhere inside us: we would be overwriting it while we copy it.
+	#if !VJSON_COPY_ON_WRITE
+		if ( _type == x._type && !InternalContains( x ) )
 		{
 			if ( _type == kObject )
-				_object = x._object;
+				RawObj() = x.RawObj();
 			else if ( _type == kArray )
-				_array = x._array;
+				RawArr() = x.RawArr();
 			else if ( _type == kString )
-				_string = x._string;
+				RawStr() = x.RawStr();
 			else
 				_dummy = x._dummy; // Some other primitive -- just copy 8 bytes
+			return *this;
 		}
-	}
-	else
-	{
-		InternalDestruct();
-		InternalConstruct(x);
-	}
-	return *this;
+	#endif
+
+	// Make the copy before we destroy our old contents, in case x is one
+	// of our children. (With copy-on-write, this just shares the storage.)
+	return *this = Value( x );
 }
 
-Value &Value::operator=( Value &&x )
+Value &Value::operator=( Value &&x ) VJSON_MOVE_NOEXCEPT
 {
-	if ( _type == x._type )
-	{
-		if ( this != &x ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+	if ( this == &x )
+		return *this;
+	#if !VJSON_COMPACT_VALUE
+		if ( _type == x._type && _type != kObject && _type != kArray )
 		{
-			if ( _type == kObject )
-				_object = std::move( x._object );
-			else if ( _type == kArray )
-				_array = std::move( x._array );
-			else if ( _type == kString )
-				_string = std::move( x._string );
+			if ( _type == kString )
+				RawStr() = std::move( x.RawStr() );
 			else
 				_dummy = x._dummy; // Some other primitive -- just copy 8 bytes
+			return *this;
 		}
-	}
-	else
-	{
-		InternalDestruct();
-		InternalConstruct( std::forward<Value>(x) );
-	}
+	#endif
+
+	// Take x out before we destroy our old contents, in case x is one of
+	// our children. (This is cheap; containers just move a few pointers.)
+	Value tmp( std::forward<Value>( x ) );
+	InternalDestruct();
+	InternalConstruct( std::move( tmp ) );
 	return *this;
 }
 
@@ -207,8 +526,8 @@ Value &Value::operator=( const char *x )
 {
 	if ( _type == kString )
 	{
-		if ( x != _string.c_str() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_string = x;
+		if ( x != RawStr().c_str() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawStr() = x;
 	}
 	else
 	{
@@ -222,8 +541,8 @@ Value &Value::operator=( const std::string &x )
 {
 	if ( _type == kString )
 	{
-		if ( &x != &_string ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_string = x;
+		if ( &x != &RawStr() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawStr() = x;
 	}
 	else
 	{
@@ -237,8 +556,8 @@ Value &Value::operator=( std::string &&x )
 {
 	if ( _type == kString )
 	{
-		if ( &x != &_string ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_string = std::forward<std::string>( x );
+		if ( &x != &RawStr() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawStr() = std::forward<std::string>( x );
 	}
 	else
 	{
@@ -253,8 +572,8 @@ Value &Value::operator=( const RawArray &x )
 {
 	if ( _type == kArray )
 	{
-		if ( &x != &_array ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_array = x;
+		if ( &x != &RawArr() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawArr() = x;
 	}
 	else
 	{
@@ -269,8 +588,8 @@ Value &Value::operator=( RawArray &&x )
 {
 	if ( _type == kArray )
 	{
-		if ( &x != &_array ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_array = std::forward<RawArray>( x );
+		if ( &x != &RawArr() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawArr() = std::forward<RawArray>( x );
 	}
 	else
 	{
@@ -285,8 +604,8 @@ Value &Value::operator=( const RawObject &x )
 {
 	if ( _type == kObject )
 	{
-		if ( &x != &_object ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_object = x;
+		if ( &x != &RawObj() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawObj() = x;
 	}
 	else
 	{
@@ -301,8 +620,8 @@ Value &Value::operator=( RawObject &&x )
 {
 	if ( _type == kObject )
 	{
-		if ( &x != &_object ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
-			_object = std::forward<RawObject>( x );
+		if ( &x != &RawObj() ) // Not sure if this is necessary. Do the STL types protect against self-assignment?
+			RawObj() = std::forward<RawObject>( x );
 	}
 	else
 	{
@@ -317,7 +636,7 @@ void Value::SetEmptyObject()
 {
 	if ( _type == kObject )
 	{
-		_object.clear();
+		RawObj().clear();
 	}
 	else
 	{
@@ -331,7 +650,7 @@ void Value::SetEmptyArray()
 {
 	if ( _type == kArray )
 	{
-		_array.clear();
+		RawArr().clear();
 	}
 	else
 	{
@@ -365,7 +684,7 @@ EResult Value::TryInterpret( std::string &outX ) const
 		}
 
 		case kString:
-			outX = _string;
+			outX = RawStr();
 			return kOK;
 
 		case kObject:
@@ -408,7 +727,7 @@ EResult Value::TryInterpret( bool &outX ) const
 
 		case kString:
 		{
-			const char *s = _string.c_str();
+			const char *s = RawStr().c_str();
 
 			// Manually do case-sensitive compare against "true" / "false".
 			// I don't want to mess with compiler compatibility, locales, etc, etc
@@ -474,8 +793,8 @@ EResult Value::TryInterpret( double &outX ) const
 		{
 			double val;
 			int n = -1;
-			sscanf( _string.c_str(), "%lf%n %n", &val, &n, &n );
-			if ( n >= 0 && _string[n] == '\0' )
+			sscanf( RawStr().c_str(), "%lf%n %n", &val, &n, &n );
+			if ( n >= 0 && RawStr()[n] == '\0' )
 			{
 				outX = val;
 				return kOK;
@@ -511,8 +830,8 @@ EResult Value::TryInterpret( int &outX ) const
 		{
 			int val;
 			int n = -1;
-			sscanf( _string.c_str(), "%d%n %n", &val, &n, &n );
-			if ( n >= 0 && _string[n] == '\0' )
+			sscanf( RawStr().c_str(), "%d%n %n", &val, &n, &n );
+			if ( n >= 0 && RawStr()[n] == '\0' )
 			{
 				outX = val;
 				return kOK;
@@ -555,8 +874,8 @@ EResult Value::TryInterpret( uint64_t &outX ) const
 		{
 			unsigned long long val;
 			int n = -1;
-			sscanf( _string.c_str(), "%llu%n %n", &val, &n, &n );
-			if ( n >= 0 && _string[n] == '\0' )
+			sscanf( RawStr().c_str(), "%llu%n %n", &val, &n, &n );
+			if ( n >= 0 && RawStr()[n] == '\0' )
 			{
 				outX = (uint64_t)val;
 				return kOK;
@@ -666,11 +985,11 @@ struct Printer
 				{
 					case '\"': buf.append( "\\\"", 2 ); break;
 					case '\\': buf.append( "\\\\", 2 ); break;
-					case '\b': buf.append( "\\\b", 2 ); break;
-					case '\f': buf.append( "\\\f", 2 ); break;
-					case '\n': buf.append( "\\\n", 2 ); break;
-					case '\r': buf.append( "\\\r", 2 ); break;
-					case '\t': buf.append( "\\\t", 2 ); break;
+					case '\b': buf.append( "\\b", 2 ); break;
+					case '\f': buf.append( "\\f", 2 ); break;
+					case '\n': buf.append( "\\n", 2 ); break;
+					case '\r': buf.append( "\\r", 2 ); break;
+					case '\t': buf.append( "\\t", 2 ); break;
 					default:
 						if ( (unsigned char)c < 0x20 )
 						{
@@ -702,8 +1021,8 @@ struct Printer
 			);
 			buf.push_back( delim );
 			buf.push_back( '\n' );
-			for ( size_t i = 0 ; i < indent_level ; ++i )
-				buf.append( opt.indent, opt.indent + indent_level );
+			for ( size_t i = 0 ; i <= indent_level ; ++i ) // Indent the first child
+				buf.append( opt.indent, indent_len );
 		}
 		else
 		{
@@ -795,7 +1114,7 @@ struct Printer
 		}
 
 		BeginBlock( '{', obj.size() );
-		const char *colon = indent_level>0 ? ": " : ":";
+		const char *colon = indent_len ? ": " : ":";
 		bool is_first = true;
 		for ( const ObjectItem &item: obj )
 		{
@@ -864,11 +1183,18 @@ std::string Value::PrintJSON( const PrintOptions &opt ) const
 struct Parser
 {
 	Parser( ParseContext &c, const char *b, const char *e )
-	: ctx(c), begin(b), end(e)
+	: ctx(c), begin(b), end(e), stats( c.stats )
 	{
 		ptr = begin;
 		line = 1;
+		if ( stats )
+		{
+			bool measure_build_time = stats->measure_build_time;
+			*stats = ParseStats{};
+			stats->measure_build_time = measure_build_time;
+		}
 
+		ctx.error = kParseOK;
 		ctx.error_byte_offset = 0;
 		ctx.error_line = 0;
 		ctx.error_message.clear();
@@ -882,7 +1208,69 @@ struct Parser
 
 	// Current cursor.
 	const char *ptr;
-	int line;
+	int64_t line;
+
+	// Resource usage, for enforcing the limits in ParseContext
+	int depth = 0;
+	size_t node_count = 0;
+	size_t alloc_bytes = 0;
+	unsigned containers_until_clock_check = 0;
+
+	// Scratch buffer for object keys
+	std::string key;
+
+	// Statistics, if requested
+	ParseStats *const stats;
+
+	// Add up time spent constructing the DOM, if requested
+	struct BuildTimer
+	{
+		ParseStats *const stats;
+		std::chrono::steady_clock::time_point start;
+		BuildTimer( ParseStats *s ) : stats( s && s->measure_build_time ? s : nullptr )
+		{
+			if ( stats )
+				start = std::chrono::steady_clock::now();
+		}
+		~BuildTimer()
+		{
+			if ( stats )
+				stats->build_time += std::chrono::steady_clock::now() - start;
+		}
+	};
+
+	// Count heap allocations, by noticing when the capacity changes
+	void CountAlloc( const std::string &s, size_t old_capacity )
+	{
+		if ( stats && s.capacity() != old_capacity )
+		{
+			++stats->allocs;
+			stats->alloc_bytes += s.capacity() + 1;
+		}
+	}
+	void CountAlloc( const RawArray &a, size_t old_capacity )
+	{
+		if ( stats && a.capacity() != old_capacity )
+		{
+			++stats->allocs;
+			stats->alloc_bytes += a.capacity() * sizeof(Value);
+		}
+	}
+	#if VJSON_FLAT_OBJECT
+	void CountAlloc( const FlatObject &o, size_t old_capacity )
+	{
+		if ( stats && o.capacity() != old_capacity )
+		{
+			++stats->allocs;
+			stats->alloc_bytes += o.capacity() * sizeof(ObjectItem);
+		}
+	}
+
+	// Memory used by each object member, for the allocation budget
+	static constexpr size_t kMemberBytes = sizeof(ObjectItem);
+	#else
+	static constexpr size_t kMemberBytes = sizeof(ObjectItem) + 4*sizeof(void*); // Typical red-black tree node overhead
+	#endif
 
 	// Return the next character, or -1 if we are at EOF
 	inline int Peek() const
@@ -892,9 +1280,10 @@ struct Parser
 		return *ptr;
 	}
 
-	void Error( const char *msg )
+	void Error( const char *msg, EParseError code = kParseSyntaxError )
 	{
-		ctx.error_byte_offset = int( ptr - begin );
+		ctx.error = code;
+		ctx.error_byte_offset = int64_t( ptr - begin );
 		ctx.error_line = line;
 		ctx.error_message = msg;
 	}
@@ -909,6 +1298,70 @@ struct Parser
 		Error( msg );
 	}
 
+	// Report that we went over one of the limits in the ParseContext
+	void LimitError( EParseError code, const char *fmt, size_t limit )
+	{
+		char msg[ 256 ];
+		snprintf( msg, sizeof(msg), fmt, (unsigned long long)limit );
+		Error( msg, code );
+	}
+
+	// Account for a new value (and any memory it needs, beyond
+	// the Value itself) and check the limits.
+	bool AddNode( size_t extra_bytes )
+	{
+		++node_count;
+		if ( ctx.max_nodes && node_count > ctx.max_nodes )
+		{
+			LimitError( kParseTooManyNodes, "Document has more than %llu values", ctx.max_nodes );
+			return false;
+		}
+		return Alloc( sizeof(Value) + extra_bytes );
+	}
+
+	bool Alloc( size_t bytes )
+	{
+		alloc_bytes += bytes;
+		if ( ctx.max_alloc_bytes && alloc_bytes > ctx.max_alloc_bytes )
+		{
+			LimitError( kParseAllocBudget, "Document would use more than %llu bytes of memory", ctx.max_alloc_bytes );
+			return false;
+		}
+		return true;
+	}
+
+	// Called when we start parsing an object or array. Checks the depth
+	// limit, and whether we should give up.
+	bool EnterContainer()
+	{
+		++depth;
+		if ( stats && depth > stats->max_depth )
+			stats->max_depth = depth;
+		if ( ctx.max_depth > 0 && depth > ctx.max_depth )
+		{
+			LimitError( kParseTooDeep, "Objects and arrays nested more than %llu levels deep", (size_t)ctx.max_depth );
+			return false;
+		}
+		if ( ctx.cancel && ctx.cancel->load( std::memory_order_relaxed ) )
+		{
+			Error( "Parsing cancelled", kParseCancelled );
+			return false;
+		}
+
+		// Reading the clock isn't free. Don't do it every time
+		if ( containers_until_clock_check == 0 )
+		{
+			containers_until_clock_check = 64;
+			if ( ctx.deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > ctx.deadline )
+			{
+				Error( "Parsing deadline exceeded", kParseDeadline );
+				return false;
+			}
+		}
+		--containers_until_clock_check;
+		return true;
+	}
+
 	// Advance ptr to skip past any whitespace.
 	// If C++ comments are allowed, we will also skip those.
 	// There is a bit of extra complexity here to maintain the
@@ -1135,6 +1588,27 @@ unterminated_string:
 			}
 		}
 
+		// Check the limits
+		size_t len = s - ptr - escape_overhead;
+		if ( ctx.max_string_length && len > ctx.max_string_length )
+		{
+			--ptr; // Report the opening quote
+			LimitError( kParseStringTooLong, "String longer than %llu bytes", ctx.max_string_length );
+			return false;
+		}
+		static const size_t kSmallStringCapacity = std::string().capacity(); // Strings this small don't allocate
+		if ( len > kSmallStringCapacity && !Alloc( len+1 ) )
+			return false;
+
+		if ( stats )
+		{
+			stats->string_bytes += len;
+			if ( escape_overhead )
+				++stats->escaped_strings;
+		}
+		BuildTimer timer( stats );
+		size_t old_capacity = out.capacity();
+
 		// Fast path for no escaped characters.
 		// (Including empty string)
 		if ( escape_overhead == 0 )
@@ -1155,7 +1629,7 @@ unterminated_string:
 			// reserve() to avoid this, but that would mean we have to use
 			// push_back or append() below, which is going to be slower.
 			// It's probably faster to just suffer the memset here?
-			out.resize( s - ptr - escape_overhead );
+			out.resize( len );
 
 			// Get a writable pointer to the string. Note that this const
 			// cast is not necessary beginning with C++17
@@ -1249,12 +1723,95 @@ unterminated_string:
 			++ptr;
 		}
 
+		CountAlloc( out, old_capacity );
+		return true;
+	}
+
+	#if VJSON_FLAT_OBJECT
+	// Members are kept in the order they were parsed, so if the document has
+	// the same shape as last time, the old member at this position has our
+	// key.  Take over its value, so its strings, arrays, etc get recycled.
+	Value &RecycleMember( RawObject &rawObj, RawObject &old_members )
+	{
+		size_t n = rawObj.size();
+		auto old = n < old_members.size() && old_members.begin()[n].first == key ? old_members.begin() + n : old_members.find( key );
+		Value &val = rawObj[ std::move( key ) ];
+		if ( old != old_members.end() )
+			val = std::move( old->second );
+		return val;
+	}
+	#elif VJSON_HAVE_CPP17
+	// Find a node for the key, by taking over a member of the old object. If
+	// we find the same key, then the value should have the same shape, too.
+	Value &RecycleMember( RawObject &rawObj, RawObject &old_members )
+	{
+		auto node = old_members.extract( key );
+		if ( !node )
+		{
+			node = old_members.extract( old_members.begin() );
+			size_t old_capacity = node.key().capacity();
+			node.key() = key;
+			CountAlloc( node.key(), old_capacity );
+		}
+
+		// If it's a duplicate key, the insert fails, and last one wins.
+		return rawObj.insert( std::move( node ) ).position->second;
+	}
+	#endif
+
+	// After a member or element, eat the ',' or the closing bracket. done
+	// is set when we reach the end of the container. (Possibly after an
+	// extra trailing comma.)
+	bool ParseSeparator( char close, bool &done )
+	{
+		SkipWhitespaceAndComments();
+		if ( !CheckEOF() )
+			return false;
+		if ( *ptr == close )
+		{
+			++ptr;
+			done = true;
+			return true;
+		}
+		if ( *ptr != ',' )
+		{
+			Errorf( "Expected '%c' or ',' but found '%c' (0x%02x) instead", close, *ptr, *ptr );
+			return false;
+		}
+
+		// Eat the comma
+		++ptr;
+
+		// End of container here? (Extra trailing comma)
+		SkipWhitespaceAndComments();
+		if ( !CheckEOF() )
+			return false;
+		if ( *ptr == close )
+		{
+			if ( !ctx.allow_trailing_comma )
+			{
+				Errorf( "JSON value required here. (Strict parsing mode; trailing comma not permitted)" );
+				return false;
+			}
+			++ptr;
+			done = true;
+		}
 		return true;
 	}
 
 	bool ParseObject( Value &out )
 	{
-		out.SetEmptyObject();
+		// When recycling, set aside the old members, so we can reuse them
+		RawObject old_members;
+		if ( ctx.reuse_storage && out.IsObject() )
+		{
+			old_members.swap( out.GetObject().Raw() );
+			#if VJSON_FLAT_OBJECT
+				out.GetObject().Raw().reserve( old_members.size() );
+			#endif
+		}
+		else
+			out.SetEmptyObject();
 
 		// Peek first character, special case for empty object
 		SkipWhitespaceAndComments();
@@ -1279,9 +1836,8 @@ unterminated_string:
 				return false;
 			}
 
-			// Parse the key
-			std::string key;
-			if ( !ParseQuotedString( key ) )
+			// Parse the key. Count the map node overhead, too.
+			if ( !ParseQuotedString( key ) || !Alloc( kMemberBytes ) )
 				return false;
 
 			// Locate and eat the colon
@@ -1299,42 +1855,42 @@ unterminated_string:
 			// does not specify what to do in case of duplicate key.
 			// We are not detecting it, and are using the "last one wins"
 			// rule.
-			Value &val = rawObj[ std::move( key ) ];
-			if ( !ParseRequiredValue( val ) )
-				return false;
-
-			// Next thing must be a comma, or a bracket to end the input
-			SkipWhitespaceAndComments();
-			if ( !CheckEOF() )
-				return false;
-			if ( *ptr == '}' )
+			Value *val;
 			{
-				++ptr;
-				break;
+				BuildTimer timer( stats );
+				#if VJSON_FLAT_OBJECT
+					size_t old_capacity = rawObj.capacity();
+				#else
+					size_t old_size = rawObj.size();
+				#endif
+				#if VJSON_HAVE_CPP17 || VJSON_FLAT_OBJECT
+					val = old_members.empty() ? &rawObj[ std::move( key ) ] : &RecycleMember( rawObj, old_members );
+				#else
+					val = &rawObj[ std::move( key ) ];
+				#endif
+				if ( stats )
+				{
+					++stats->keys;
+					#if VJSON_FLAT_OBJECT
+						CountAlloc( rawObj, old_capacity );
+					#else
+						if ( rawObj.size() != old_size && old_members.empty() )
+						{
+							++stats->allocs;
+							stats->alloc_bytes += kMemberBytes;
+						}
+					#endif
+				}
 			}
-			if ( *ptr != ',' )
-			{
-				Errorf( "Expected '}' or ',' but found '%c' (0x%02x) instead", *ptr, *ptr );
+			if ( !ParseRequiredValue( *val ) )
 				return false;
-			}
-
-			// Eat the comma
-			++ptr;
 
-			// End of object here? (Extra trailing comma)
-			SkipWhitespaceAndComments();
-			if ( !CheckEOF() )
+			// Next thing must be a comma, or a bracket to end the input
+			bool done = false;
+			if ( !ParseSeparator( '}', done ) )
 				return false;
-			if ( *ptr == '}' )
-			{
-				if ( !ctx.allow_trailing_comma )
-				{
-					Errorf( "JSON value required here. (Strict parsing mode; trailing comma not permitted)", *ptr, *ptr );
-					return false;
-				}
-				++ptr;
+			if ( done )
 				break;
-			}
 		}
 
 		return true;
@@ -1342,7 +1898,10 @@ unterminated_string:
 
 	bool ParseArray( Value &out )
 	{
-		out.SetEmptyArray();
+		// When recycling, keep the old elements and parse over the top of them
+		if ( !ctx.reuse_storage || !out.IsArray() )
+			out.SetEmptyArray();
+		RawArray &rawArray = out.GetArray().Raw();
 
 		// Peek first character, special case for empty array
 		SkipWhitespaceAndComments();
@@ -1351,57 +1910,37 @@ unterminated_string:
 		if ( *ptr == ']' )
 		{
 			++ptr;
+			rawArray.clear();
 			return true;
 		}
 
 		// OK, parse items into the array
-		RawArray &rawArray = out.GetArray().Raw();
-
+		size_t n = 0;
 		for (;;)
 		{
 
-			// Parse into a temporary object
-			Value val;
-			if ( !ParseRequiredValue( val ) )
-				return false;
-
-			// Move into array
-			rawArray.emplace_back( std::move( val ) );
-
-			// Next thing must be a comma, or a bracket to end the input
-			SkipWhitespaceAndComments();
-			if ( !CheckEOF() )
-				return false;
-			if ( *ptr == ']' )
+			// Parse directly into the array
+			if ( n == rawArray.size() )
 			{
-				++ptr;
-				break;
+				BuildTimer timer( stats );
+				size_t old_capacity = rawArray.capacity();
+				rawArray.emplace_back();
+				CountAlloc( rawArray, old_capacity );
 			}
-			if ( *ptr != ',' )
-			{
-				Errorf( "Expected ']' or ',' but found '%c' (0x%02x) instead", *ptr, *ptr );
+			if ( !ParseRequiredValue( rawArray[n] ) )
 				return false;
-			}
-
-			// Eat the comma
-			++ptr;
+			++n;
 
-			// End of array here? (Extra trailing comma)
-			SkipWhitespaceAndComments();
-			if ( !CheckEOF() )
+			// Next thing must be a comma, or a bracket to end the input
+			bool done = false;
+			if ( !ParseSeparator( ']', done ) )
 				return false;
-			if ( *ptr == ']' )
-			{
-				if ( !ctx.allow_trailing_comma )
-				{
-					Errorf( "JSON value required here. (Strict parsing mode; trailing comma not permitted)", *ptr, *ptr );
-					return false;
-				}
-				++ptr;
+			if ( done )
 				break;
-			}
 		}
 
+		// Discard any leftover elements from the old array
+		rawArray.erase( rawArray.begin() + n, rawArray.end() );
 		return true;
 	}
 
@@ -1546,6 +2085,8 @@ unterminated_string:
 		}
 
 		out = number_val;
+		if ( stats )
+			++stats->numbers;
 		return true;
 	}
 
@@ -1562,12 +2103,18 @@ unterminated_string:
 	// and we have skipped whitespace and comments
 	bool InternalParseValue( Value &out )
 	{
+		if ( !AddNode( 0 ) )
+			return false;
 
 		// Check character to know what it is
 		switch ( *ptr )
 		{
 			case '\"':
 			{
+				if ( stats )
+					++stats->strings;
+				if ( ctx.reuse_storage && out.IsString() )
+					return ParseQuotedString( out.GetString() );
 				std::string s;
 				if ( !ParseQuotedString( s ) )
 					return false;
@@ -1591,18 +2138,36 @@ unterminated_string:
 				return ParseNumber( out );
 
 			case '{':
+			{
+				if ( stats )
+					++stats->objects;
+				if ( !EnterContainer() )
+					return false;
 				++ptr;
-				return ParseObject( out );
+				bool ok = ParseObject( out );
+				--depth;
+				return ok;
+			}
 
 			case '[':
+			{
+				if ( stats )
+					++stats->arrays;
+				if ( !EnterContainer() )
+					return false;
 				++ptr;
-				return ParseArray( out );
+				bool ok = ParseArray( out );
+				--depth;
+				return ok;
+			}
 
 			case 't':
 				if ( ptr + 4 <= end && ptr[1] == 'r' && ptr[2] == 'u' && ptr[3] == 'e' )
 				{
 					out = true;
 					ptr += 4;
+					if ( stats )
+						++stats->bools;
 					return true;
 				}
 				break;
@@ -1612,6 +2177,8 @@ unterminated_string:
 				{
 					out = false;
 					ptr += 5;
+					if ( stats )
+						++stats->bools;
 					return true;
 				}
 				break;
@@ -1621,6 +2188,8 @@ unterminated_string:
 				{
 					out.SetNull();
 					ptr += 4;
+					if ( stats )
+						++stats->nulls;
 					return true;
 				}
 				break;
@@ -1631,6 +2200,27 @@ unterminated_string:
 		return false;
 	}
 
+	// Parse the whole input, which must be exactly one value
+	bool ParseDocument( Value &out )
+	{
+		if ( ctx.max_input_bytes && size_t( end - begin ) > ctx.max_input_bytes )
+		{
+			LimitError( kParseInputTooLarge, "Input is larger than %llu bytes", ctx.max_input_bytes );
+			return false;
+		}
+		if ( !ParseRequiredValue( out ) )
+			return false;
+
+		// Check for any extra characters
+		SkipWhitespaceAndComments();
+		int c = Peek();
+		if ( c < 0 )
+			return true;
+
+		Errorf( "Extra text starting with character 0x%02x='%c'", c, c );
+		return false;
+	}
+
 };
 
 bool Value::ParseJSON( const char *begin, const char *end, ParseContext *ctx )
@@ -1643,32 +2233,140 @@ bool Value::ParseJSON( const char *begin, const char *end, ParseContext *ctx )
 
 	ParseContext dummy_ctx;
 	Parser p( ctx ? *ctx : dummy_ctx, begin, end );
-	if ( !p.ParseRequiredValue( *this ) )
-	{
+	std::chrono::steady_clock::time_point start;
+	if ( p.stats )
+		start = std::chrono::steady_clock::now();
+
+	bool ok = p.ParseDocument( *this );
+	if ( !ok )
 		SetNull();
-		return false;
+
+	if ( p.stats )
+	{
+		p.stats->bytes = size_t( p.ptr - begin );
+		p.stats->total_time = std::chrono::steady_clock::now() - start;
+	}
+	return ok;
+}
+
+// Read-only memory mapping of an entire file
+struct MappedFile
+{
+	const char *data = nullptr;
+	size_t size = 0;
+
+	#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+	#endif
+
+	~MappedFile()
+	{
+		#ifdef _WIN32
+			if ( data )
+				UnmapViewOfFile( data );
+			if ( mapping )
+				CloseHandle( mapping );
+			if ( file != INVALID_HANDLE_VALUE )
+				CloseHandle( file );
+		#else
+			if ( data )
+				munmap( const_cast<char *>( data ), size );
+		#endif
 	}
 
-	// Check for any extra characters
-	p.SkipWhitespaceAndComments();
-	int c = p.Peek();
-	if ( c < 0 )
+	// Map the file. On failure, fill in the error in the context
+	bool Open( const char *filename, ParseContext &ctx )
+	{
+		#ifdef _WIN32
+			file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+			if ( file == INVALID_HANDLE_VALUE )
+				return Error( ctx, filename, "Can't open", (int)GetLastError() );
+			LARGE_INTEGER file_size;
+			if ( !GetFileSizeEx( file, &file_size ) )
+				return Error( ctx, filename, "Can't get size of", (int)GetLastError() );
+			size = (size_t)file_size.QuadPart;
+			if ( size == 0 )
+				return true; // Can't map an empty file
+			mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+			if ( !mapping )
+				return Error( ctx, filename, "Can't map", (int)GetLastError() );
+			data = (const char *)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			if ( !data )
+				return Error( ctx, filename, "Can't map", (int)GetLastError() );
+			// Windows doesn't do large pages for file mappings. Ignore ctx.file_huge_pages
+		#else
+			int fd = open( filename, O_RDONLY );
+			if ( fd < 0 )
+				return Error( ctx, filename, "Can't open", errno );
+			struct stat st;
+			if ( fstat( fd, &st ) != 0 )
+			{
+				int err = errno;
+				close( fd );
+				return Error( ctx, filename, "Can't stat", err );
+			}
+			size = (size_t)st.st_size;
+			if ( size == 0 )
+			{
+				close( fd );
+				return true; // Can't map an empty file
+			}
+			void *p = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			int err = errno;
+			close( fd ); // The mapping keeps the file open
+			if ( p == MAP_FAILED )
+				return Error( ctx, filename, "Can't map", err );
+			data = (const char *)p;
+
+			// We read front to back, exactly once
+			madvise( p, size, MADV_SEQUENTIAL );
+			#ifdef MADV_HUGEPAGE
+				if ( ctx.file_huge_pages )
+					madvise( p, size, MADV_HUGEPAGE ); // Just a hint. OK if it fails
+			#endif
+		#endif
 		return true;
+	}
 
-	p.Errorf( "Extra text starting with character 0x%02x='%c'", c, c );
-	SetNull();
-	return false;
-}
+	static bool Error( ParseContext &ctx, const char *filename, const char *what, int err )
+	{
+		char msg[ 512 ];
+		#ifdef _WIN32
+			snprintf( msg, sizeof(msg), "%s '%s'.  (Error %d)", what, filename, err );
+		#else
+			snprintf( msg, sizeof(msg), "%s '%s'.  %s", what, filename, strerror( err ) );
+		#endif
+		ctx.error = kParseFileError;
+		ctx.error_line = 0;
+		ctx.error_byte_offset = 0;
+		ctx.error_message = msg;
+		return false;
+	}
+};
 
-bool InternalParseTyped( Value &out, const char *begin, const char *end,
-	ParseContext *ctx, EValueType expected_type, const char *expected_type_name )
+bool Value::ParseFile( const char *filename, ParseContext *ctx )
 {
-	if ( !out.ParseJSON( begin, end, ctx ) )
+	ParseContext dummy_ctx;
+	ParseContext &c = ctx ? *ctx : dummy_ctx;
+	MappedFile file;
+	if ( !file.Open( filename, c ) )
+	{
+		SetNull();
 		return false;
+	}
+	const char *data = file.data ? file.data : "";
+	return ParseJSON( data, data + file.size, &c );
+}
+
+// Check that we parsed the type we were expecting
+bool InternalCheckType( Value &out, ParseContext *ctx, EValueType expected_type, const char *expected_type_name )
+{
 	if ( out.Type() == expected_type )
 		return true;
 	if ( ctx )
 	{
+		ctx->error = kParseWrongType;
 		ctx->error_line = 1;
 		ctx->error_byte_offset = 0;
 
@@ -1681,15 +2379,1921 @@ bool InternalParseTyped( Value &out, const char *begin, const char *end,
 
 bool Object::ParseJSON( const char *begin, const char *end, ParseContext *ctx )
 {
-	if ( InternalParseTyped( *this, begin, end, ctx, kObject, "object" ) )
+	if ( Value::ParseJSON( begin, end, ctx ) && InternalCheckType( *this, ctx, kObject, "object" ) )
+		return true;
+	SetEmptyObject(); // Type safety in case caller reuses
+	return false;
+}
+
+bool Object::ParseFile( const char *filename, ParseContext *ctx )
+{
+	if ( Value::ParseFile( filename, ctx ) && InternalCheckType( *this, ctx, kObject, "object" ) )
 		return true;
 	SetEmptyObject(); // Type safety in case caller reuses
 	return false;
 }
 
+template <typename T>
+static StridedSpan<T> AllOfType( const RawArray &arr, EValueType t )
+{
+	for ( const Value &v: arr )
+	{
+		if ( v.Type() != t )
+			return StridedSpan<T>();
+	}
+	if ( arr.empty() )
+		return StridedSpan<T>();
+	return StridedSpan<T>( &arr[0].Get<T>(), arr.size() );
+}
+
+StridedSpan<double> Array::Numbers() const
+{
+	VJSON_ASSERT( _type == kArray );
+	return AllOfType<double>( RawArr(), kDouble );
+}
+
+StridedSpan<bool> Array::Bools() const
+{
+	VJSON_ASSERT( _type == kArray );
+	return AllOfType<bool>( RawArr(), kBool );
+}
+
+// Aggregation kernels.  The numbers live inside the Values of the array,
+// not packed together, so we can't run SIMD over them directly.  Instead,
+// we copy them into a small block on the stack, a few hundred at a time,
+// skipping anything that isn't a number without a branch.  Then we reduce
+// the block, which is contiguous.  We keep a separate sum, min and max in
+// each of several lanes, so that no element depends on the previous one,
+// and the compiler can keep the lanes in vector registers.
+static constexpr size_t kGatherBlock = 256;
+static constexpr int kReduceLanes = 4;
+
+// Call flush( block, n ) with the numbers fetched from each element, in order.
+// fetch( value, out ) stores a number in *out and returns 1, or returns 0
+// to skip the element.  (It may write *out either way.)
+template <typename Fetch, typename Flush>
+static void GatherNumbers( const RawArray &arr, Fetch &&fetch, Flush &&flush )
+{
+	double block[ kGatherBlock ];
+	const Value *p = arr.data();
+	const Value *end = p + arr.size();
+	while ( p < end )
+	{
+		size_t n = 0;
+		const Value *stop = p + std::min( size_t( end - p ), kGatherBlock );
+		for ( ; p < stop ; ++p )
+			n += fetch( *p, &block[n] );
+		if ( n > 0 )
+			flush( block, n );
+	}
+}
+
+static size_t FetchNumber( const Value &x, double *out )
+{
+	*out = x.AsDouble( 0.0 );
+	return x.IsNumber() ? 1 : 0;
+}
+
+namespace
+{
+	struct NumberAccumulator
+	{
+		size_t count = 0;
+		double sum[ kReduceLanes ] = {};
+		double lo[ kReduceLanes ] = {};
+		double hi[ kReduceLanes ] = {};
+
+		void Add( const double *x, size_t n )
+		{
+			if ( count == 0 )
+			{
+				for ( int l = 0 ; l < kReduceLanes ; ++l )
+					lo[l] = hi[l] = x[0];
+			}
+			count += n;
+
+			size_t i = 0;
+			for ( ; i + kReduceLanes <= n ; i += kReduceLanes )
+			{
+				for ( int l = 0 ; l < kReduceLanes ; ++l )
+				{
+					double v = x[i+l];
+					sum[l] += v;
+					lo[l] = v < lo[l] ? v : lo[l];
+					hi[l] = v > hi[l] ? v : hi[l];
+				}
+			}
+			for ( ; i < n ; ++i )
+			{
+				double v = x[i];
+				sum[0] += v;
+				lo[0] = v < lo[0] ? v : lo[0];
+				hi[0] = v > hi[0] ? v : hi[0];
+			}
+		}
+
+		NumberStats Finish() const
+		{
+			NumberStats result;
+			result.count = count;
+			if ( count > 0 )
+			{
+				result.min = lo[0];
+				result.max = hi[0];
+				for ( int l = 0 ; l < kReduceLanes ; ++l )
+				{
+					result.sum += sum[l];
+					result.min = std::min( result.min, lo[l] );
+					result.max = std::max( result.max, hi[l] );
+				}
+			}
+			return result;
+		}
+	};
+
+	struct HistogramAccumulator
+	{
+		std::vector<size_t> counts;
+		double lo, hi, scale;
+
+		HistogramAccumulator( double lo_, double hi_, size_t buckets )
+		: counts( buckets ), lo( lo_ ), hi( hi_ ), scale( hi_ > lo_ ? (double)buckets / ( hi_ - lo_ ) : 0.0 ) {}
+
+		void Add( const double *x, size_t n )
+		{
+			if ( counts.empty() || scale == 0.0 )
+				return;
+			size_t last = counts.size() - 1;
+			for ( size_t i = 0 ; i < n ; ++i )
+			{
+				double v = x[i];
+				if ( !( v >= lo && v < hi ) )
+					continue;
+				size_t b = (size_t)( ( v - lo ) * scale );
+				++counts[ std::min( b, last ) ]; // Rounding can land exactly on the end
+			}
+		}
+	};
+}
+
+NumberStats Array::Summarize() const
+{
+	VJSON_ASSERT( _type == kArray );
+	NumberAccumulator acc;
+	GatherNumbers( RawArr(), FetchNumber, [&acc]( const double *x, size_t n ) { acc.Add( x, n ); } );
+	return acc.Finish();
+}
+
+std::vector<size_t> Array::Histogram( double lo, double hi, size_t buckets ) const
+{
+	VJSON_ASSERT( _type == kArray );
+	HistogramAccumulator acc( lo, hi, buckets );
+	GatherNumbers( RawArr(), FetchNumber, [&acc]( const double *x, size_t n ) { acc.Add( x, n ); } );
+	return std::move( acc.counts );
+}
+
+// Fetch the numeric field from an element of an array of objects.  Use a
+// CachedKey, since the elements are usually all the same shape
+struct FetchNumberAtKey
+{
+	const CachedKey &key;
+	size_t operator()( const Value &x, double *out ) const
+	{
+		const Value *v = x.ValuePtrAtKey( key );
+		return v ? FetchNumber( *v, out ) : 0;
+	}
+};
+
+NumberStats Array::SummarizeAtKey( const Key &key ) const
+{
+	VJSON_ASSERT( _type == kArray );
+	CachedKey cached( key );
+	NumberAccumulator acc;
+	GatherNumbers( RawArr(), FetchNumberAtKey{ cached }, [&acc]( const double *x, size_t n ) { acc.Add( x, n ); } );
+	return acc.Finish();
+}
+
+std::vector<size_t> Array::HistogramAtKey( const Key &key, double lo, double hi, size_t buckets ) const
+{
+	VJSON_ASSERT( _type == kArray );
+	CachedKey cached( key );
+	HistogramAccumulator acc( lo, hi, buckets );
+	GatherNumbers( RawArr(), FetchNumberAtKey{ cached }, [&acc]( const double *x, size_t n ) { acc.Add( x, n ); } );
+	return std::move( acc.counts );
+}
+
+// After moving a value out, leave behind an empty container of the same
+// type, so that an Object& or Array& referring to it is still valid.
+static void ResetAfterMove( Value &x, EValueType t )
+{
+	if ( t == kObject )
+		x.SetEmptyObject();
+	else if ( t == kArray )
+		x.SetEmptyArray();
+	else
+		x.SetNull();
+}
+
+void Value::Destroy()
+{
+	std::vector<Value> pending;
+	EValueType t = _type;
+	pending.emplace_back( std::move( *this ) );
+	ResetAfterMove( *this, t );
+	while ( !pending.empty() )
+	{
+		Value v( std::move( pending.back() ) );
+		pending.pop_back();
+
+		// Move out any children that are containers, so that when v
+		// dies, it is shallow. (With copy-on-write, if somebody else
+		// can see this container, we just drop our reference.)
+		if ( v._type == kObject )
+		{
+			#if VJSON_COPY_ON_WRITE
+				if ( v._object->refs.load( std::memory_order_acquire ) != 1 )
+					continue;
+			#endif
+			for ( ObjectItem &item: v.RawObj() )
+			{
+				if ( item.second._type == kObject || item.second._type == kArray )
+					pending.emplace_back( std::move( item.second ) );
+			}
+		}
+		else if ( v._type == kArray )
+		{
+			#if VJSON_COPY_ON_WRITE
+				if ( v._array->refs.load( std::memory_order_acquire ) != 1 )
+					continue;
+			#endif
+			for ( Value &x: v.RawArr() )
+			{
+				if ( x._type == kObject || x._type == kArray )
+					pending.emplace_back( std::move( x ) );
+			}
+		}
+	}
+}
+
+// Is the string stored on the heap, or in the std::string itself?
+static inline bool StringOnHeap( const std::string &s )
+{
+	static const size_t kInlineCapacity = std::string().capacity();
+	return s.capacity() > kInlineCapacity;
+}
+
+MemoryStats Value::MemoryUsage() const
+{
+	MemoryStats m;
+	m.values += sizeof(Value);
+
+	// No recursion, so deep documents can't blow the stack
+	std::vector<const Value *> pending( 1, this );
+	while ( !pending.empty() )
+	{
+		const Value *v = pending.back();
+		pending.pop_back();
+		switch ( v->_type )
+		{
+			case kString:
+			{
+				#if VJSON_COMPACT_VALUE
+					m.overhead += sizeof( *v->_string );
+				#endif
+				const std::string &str = v->RawStr();
+				if ( StringOnHeap( str ) )
+				{
+					m.strings += str.length() + 1;
+					m.slack += str.capacity() - str.length();
+				}
+				break;
+			}
+
+			case kArray:
+			{
+				#if VJSON_COMPACT_VALUE
+					m.overhead += sizeof( *v->_array );
+				#endif
+				const RawArray &arr = v->RawArr();
+				m.values += arr.size() * sizeof(Value);
+				m.slack += ( arr.capacity() - arr.size() ) * sizeof(Value);
+				for ( const Value &x: arr )
+					pending.push_back( &x );
+				break;
+			}
+
+			case kObject:
+			{
+				#if VJSON_COMPACT_VALUE
+					m.overhead += sizeof( *v->_object );
+				#endif
+				const RawObject &obj = v->RawObj();
+				m.values += obj.size() * sizeof(Value);
+				#if VJSON_FLAT_OBJECT
+					m.overhead += obj.size() * ( sizeof(ObjectItem) - sizeof(Value) ) + obj.index_bytes();
+					m.slack += ( obj.capacity() - obj.size() ) * sizeof(ObjectItem);
+				#else
+					m.overhead += obj.size() * ( sizeof(ObjectItem) - sizeof(Value) + 4*sizeof(void*) ); // Typical red-black tree node overhead, same as the parser assumes
+				#endif
+				for ( const ObjectItem &item: obj )
+				{
+					if ( StringOnHeap( item.first ) )
+					{
+						m.keys += item.first.length() + 1;
+						m.slack += item.first.capacity() - item.first.length();
+					}
+					pending.push_back( &item.second );
+				}
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+	return m;
+}
+
+void Value::Compact()
+{
+	std::vector<Value *> pending( 1, this );
+	while ( !pending.empty() )
+	{
+		Value *v = pending.back();
+		pending.pop_back();
+
+		#if VJSON_COPY_ON_WRITE
+			// Don't touch anything that's shared.  (Accessing it for
+			// modification would make a copy.)
+			if ( ( v->_type == kObject && v->_object->refs.load( std::memory_order_acquire ) != 1 )
+				|| ( v->_type == kArray && v->_array->refs.load( std::memory_order_acquire ) != 1 )
+				|| ( v->_type == kString && v->_string->refs.load( std::memory_order_acquire ) != 1 ) )
+				continue;
+		#endif
+
+		switch ( v->_type )
+		{
+			case kString:
+				v->RawStr().shrink_to_fit();
+				break;
+
+			case kArray:
+			{
+				RawArray &arr = v->RawArr();
+				arr.shrink_to_fit();
+				for ( Value &x: arr )
+					pending.push_back( &x );
+				break;
+			}
+
+			case kObject:
+			{
+				RawObject &obj = v->RawObj();
+				#if VJSON_FLAT_OBJECT
+					obj.shrink_to_fit();
+					for ( ObjectItem &item: obj )
+						item.first.shrink_to_fit();
+				#endif
+				for ( ObjectItem &item: obj )
+					pending.push_back( &item.second );
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+}
+
+Value Value::Clone() const
+{
+	// Copy a string or scalar. A string is constructed from scratch, so
+	// with copy-on-write it isn't shared. A container is left null here,
+	// and filled in when we get to it.
+	auto CloneLeaf = []( const Value &x ) -> Value
+	{
+		switch ( x._type )
+		{
+			case kObject: case kArray: return Value();
+			case kString: return Value( x.RawStr() );
+			default: return x;
+		}
+	};
+	if ( _type != kObject && _type != kArray )
+		return CloneLeaf( *this );
+
+	// No recursion, so deep documents can't blow the stack. Each container
+	// is completely filled in before its children are queued, so the
+	// pointers in the queue stay valid.
+	Value result;
+	std::vector< std::pair<const Value *, Value *> > pending( 1, std::make_pair( this, &result ) );
+	while ( !pending.empty() )
+	{
+		const Value *src = pending.back().first;
+		Value *dst = pending.back().second;
+		pending.pop_back();
+		if ( src->_type == kObject )
+		{
+			const RawObject &from = src->RawObj();
+			dst->SetEmptyObject();
+			RawObject &to = dst->RawObj();
+			#if VJSON_FLAT_OBJECT
+				to.reserve( from.size() );
+				for ( const ObjectItem &item: from )
+					to[ item.first ] = CloneLeaf( item.second );
+			#else
+				for ( const ObjectItem &item: from )
+					to.emplace_hint( to.end(), item.first, CloneLeaf( item.second ) ); // Already sorted
+			#endif
+			RawObject::iterator it = to.begin();
+			for ( const ObjectItem &item: from )
+			{
+				if ( item.second._type == kObject || item.second._type == kArray )
+					pending.emplace_back( &item.second, &it->second );
+				++it;
+			}
+		}
+		else
+		{
+			const RawArray &from = src->RawArr();
+			dst->SetEmptyArray();
+			RawArray &to = dst->RawArr();
+			to.reserve( from.size() );
+			for ( const Value &x: from )
+				to.emplace_back( CloneLeaf( x ) );
+			for ( size_t i = 0 ; i < from.size() ; ++i )
+			{
+				if ( from[i]._type == kObject || from[i]._type == kArray )
+					pending.emplace_back( &from[i], &to[i] );
+			}
+		}
+	}
+	return result;
+}
+
+struct Reclaimer::State
+{
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::vector<Value> queue;
+	bool busy = false;
+	bool quit = false;
+	std::thread thread;
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> l( lock );
+		for (;;)
+		{
+			if ( queue.empty() )
+			{
+				busy = false;
+				done.notify_all();
+				if ( quit )
+					return;
+				wake.wait( l );
+				continue;
+			}
+
+			// Grab everything in the queue, and destroy it without holding the lock
+			std::vector<Value> work;
+			work.swap( queue );
+			busy = true;
+			l.unlock();
+			for ( Value &v: work )
+				v.Destroy();
+			work.clear();
+			l.lock();
+		}
+	}
+};
+
+Reclaimer::Reclaimer() : _state( new State )
+{
+	_state->thread = std::thread( [this] { _state->Run(); } );
+}
+
+Reclaimer::~Reclaimer()
+{
+	{
+		std::lock_guard<std::mutex> l( _state->lock );
+		_state->quit = true;
+	}
+	_state->wake.notify_one();
+	_state->thread.join();
+	delete _state;
+}
+
+void Reclaimer::Reclaim( Value &&x )
+{
+	EValueType t = x.Type();
+	{
+		std::lock_guard<std::mutex> l( _state->lock );
+		_state->queue.emplace_back( std::forward<Value>( x ) );
+	}
+	ResetAfterMove( x, t );
+	_state->wake.notify_one();
+}
+
+void Reclaimer::Flush()
+{
+	std::unique_lock<std::mutex> l( _state->lock );
+	_state->done.wait( l, [this] { return _state->queue.empty() && !_state->busy; } );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// ThreadPool
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct ThreadPool::State
+{
+	struct Job
+	{
+		const std::function<void( size_t, size_t )> *fn;
+		size_t grain;
+		std::atomic<size_t> remaining; // Elements not finished yet
+	};
+	struct Task
+	{
+		Job *job;
+		size_t begin, end;
+	};
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	// One queue per worker, plus one at the end shared by outside threads
+	std::unique_ptr<Queue[]> queues;
+	size_t queue_count = 0;
+	std::vector<std::thread> threads;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::atomic<size_t> queued{0};
+	bool quit = false;
+
+	// Which pool and queue the current thread works for, if any
+	static thread_local State *current;
+	static thread_local size_t current_queue;
+
+	void Notify( bool all )
+	{
+		// Take the lock, so that a thread that just saw nothing to do
+		// can't miss this before it starts waiting
+		{
+			std::lock_guard<std::mutex> l( lock );
+		}
+		if ( all )
+			wake.notify_all();
+		else
+			wake.notify_one();
+	}
+
+	void Push( size_t q, const Task &t )
+	{
+		++queued; // Before it's visible, so that this can't go below zero
+		{
+			std::lock_guard<std::mutex> l( queues[q].lock );
+			queues[q].tasks.push_back( t );
+		}
+		Notify( false );
+	}
+
+	// Take the newest task from our own queue, or else steal the oldest
+	// (which is the biggest) from somebody else's
+	bool Pop( size_t q, Task &out )
+	{
+		if ( queued.load( std::memory_order_acquire ) == 0 )
+			return false;
+		for ( size_t i = 0 ; i < queue_count ; ++i )
+		{
+			Queue &queue = queues[ ( q + i ) % queue_count ];
+			std::lock_guard<std::mutex> l( queue.lock );
+			if ( queue.tasks.empty() )
+				continue;
+			if ( i == 0 )
+			{
+				out = queue.tasks.back();
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				out = queue.tasks.front();
+				queue.tasks.pop_front();
+			}
+			--queued;
+			return true;
+		}
+		return false;
+	}
+
+	void Run( size_t q, Task t )
+	{
+		// Split off the back half until the piece is small enough, leaving
+		// the halves for anybody who is idle
+		while ( t.end - t.begin > t.job->grain )
+		{
+			size_t mid = t.begin + ( t.end - t.begin ) / 2;
+			Push( q, Task{ t.job, mid, t.end } );
+			t.end = mid;
+		}
+		(*t.job->fn)( t.begin, t.end );
+		if ( t.job->remaining.fetch_sub( t.end - t.begin, std::memory_order_acq_rel ) == t.end - t.begin )
+			Notify( true ); // Job is done.  Wake up whoever is waiting for it
+	}
+
+	// Help out until the job is done
+	void Wait( size_t q, Job &job )
+	{
+		while ( job.remaining.load( std::memory_order_acquire ) != 0 )
+		{
+			Task t;
+			if ( Pop( q, t ) )
+			{
+				Run( q, t );
+				continue;
+			}
+			std::unique_lock<std::mutex> l( lock );
+			wake.wait( l, [this, &job] { return job.remaining.load( std::memory_order_acquire ) == 0 || queued.load() > 0; } );
+		}
+	}
+
+	void Work( size_t q )
+	{
+		current = this;
+		current_queue = q;
+		for (;;)
+		{
+			Task t;
+			if ( Pop( q, t ) )
+			{
+				Run( q, t );
+				continue;
+			}
+			std::unique_lock<std::mutex> l( lock );
+			wake.wait( l, [this] { return quit || queued.load() > 0; } );
+			if ( quit && queued.load() == 0 )
+				return;
+		}
+	}
+};
+
+thread_local ThreadPool::State *ThreadPool::State::current = nullptr;
+thread_local size_t ThreadPool::State::current_queue = 0;
+
+ThreadPool::ThreadPool() : ThreadPool( std::max( 1u, std::thread::hardware_concurrency() ) - 1 )
+{
+}
+
+ThreadPool::ThreadPool( unsigned threads ) : _state( new State )
+{
+	_state->queue_count = threads + 1;
+	_state->queues.reset( new State::Queue[ _state->queue_count ] );
+	_state->threads.reserve( threads );
+	for ( unsigned i = 0 ; i < threads ; ++i )
+		_state->threads.emplace_back( [this, i] { _state->Work( i ); } );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> l( _state->lock );
+		_state->quit = true;
+	}
+	_state->wake.notify_all();
+	for ( std::thread &t: _state->threads )
+		t.join();
+	delete _state;
+}
+
+unsigned ThreadPool::size() const
+{
+	return (unsigned)_state->threads.size();
+}
+
+void ThreadPool::ParallelFor( size_t n, size_t grain, const std::function<void( size_t, size_t )> &fn )
+{
+	if ( grain == 0 )
+		grain = 1;
+	if ( n == 0 )
+		return;
+
+	// Small enough, or nobody to help?  Just do it
+	if ( n <= grain || _state->threads.empty() )
+	{
+		fn( 0, n );
+		return;
+	}
+
+	State::Job job;
+	job.fn = &fn;
+	job.grain = grain;
+	job.remaining = n;
+	size_t q = State::current == _state ? State::current_queue : _state->queue_count - 1;
+	_state->Run( q, State::Task{ &job, 0, n } );
+	_state->Wait( q, job );
+}
+
+uint64_t Document::NextGeneration()
+{
+	static std::atomic<uint64_t> s_generation{0};
+	return ++s_generation;
+}
+
+Document::Document( Document &&x ) : ctx( std::move( x.ctx ) ), _root( std::move( x._root ) ), _spare( std::move( x._spare ) )
+{
+	x.Release();
+}
+
+Document &Document::operator=( const Document &x )
+{
+	if ( this != &x )
+	{
+		ctx = x.ctx;
+		_root = x._root;
+		Touch();
+	}
+	return *this;
+}
+
+Document &Document::operator=( Document &&x )
+{
+	if ( this != &x )
+	{
+		ctx = std::move( x.ctx );
+		_root = std::move( x._root );
+		_spare = std::move( x._spare );
+		Touch();
+		x.Release();
+	}
+	return *this;
+}
+
+void Document::Reset()
+{
+	Touch();
+
+	// Moving the top-level container just moves a few pointers
+	if ( !_root.IsNull() )
+		_spare = std::move( _root );
+	_root.SetNull();
+}
+
+void Document::Recycle()
+{
+	Touch();
+	if ( _root.IsNull() )
+	{
+		_root = std::move( _spare );
+		_spare.SetNull();
+	}
+	ctx.reuse_storage = true;
+}
+
+bool Document::ParseJSON( const char *begin, const char *end )
+{
+	Recycle();
+	return _root.ParseJSON( begin, end, &ctx );
+}
+
+bool Document::ParseFile( const char *filename )
+{
+	Recycle();
+	return _root.ParseFile( filename, &ctx );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Moving members and elements between containers
+//
+/////////////////////////////////////////////////////////////////////////////
+
+Value *Object::Insert( ObjectNode &&node )
+{
+	VJSON_ASSERT( _type == kObject );
+	if ( node.empty() )
+		return nullptr;
+	RawObject &raw = RawObj();
+	#if VJSON_HAVE_CPP17 && !VJSON_FLAT_OBJECT
+		auto r = raw.insert( std::move( node ) );
+		if ( !r.inserted )
+			r.position->second = std::move( r.node.mapped() ); // Key was present.  Replace the value
+		return &r.position->second;
+	#else
+		Value &v = raw[ std::move( node.key() ) ];
+		v = std::move( node.mapped() );
+		node = ObjectNode();
+		return &v;
+	#endif
+}
+
+size_t Array::Splice( size_t first, size_t last, Array &dst )
+{
+	VJSON_ASSERT( _type == kArray && dst._type == kArray && &dst != this );
+	RawArray &src = RawArr();
+	if ( last > src.size() )
+		last = src.size();
+	if ( first >= last )
+		return 0;
+	RawArray &out = dst.RawArr();
+	out.insert( out.end(), std::make_move_iterator( src.begin() + first ), std::make_move_iterator( src.begin() + last ) );
+	src.erase( src.begin() + first, src.begin() + last );
+	return last - first;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// KeySet
+//
+/////////////////////////////////////////////////////////////////////////////
+
+KeySet::KeySet( std::initializer_list<const char *> keys )
+{
+	_keys.reserve( keys.size() );
+	for ( const char *k: keys )
+		_keys.emplace_back( k );
+	Init();
+}
+
+KeySet::KeySet( const std::vector<std::string> &keys ) : _keys( keys )
+{
+	Init();
+}
+
+void KeySet::Init()
+{
+	_hashes.resize( _keys.size() );
+	_sorted.resize( _keys.size() );
+	for ( size_t i = 0 ; i < _keys.size() ; ++i )
+	{
+		_hashes[i] = HashKey( _keys[i].c_str(), _keys[i].length() );
+		_sorted[i] = uint32_t( i );
+	}
+	std::sort( _sorted.begin(), _sorted.end(), [this]( uint32_t a, uint32_t b ) { return ObjectKeyLess()( _keys[a], _keys[b] ); } );
+}
+
+size_t Value::ValuePtrsAtKeys( const KeySet &keys, const Value **out ) const
+{
+	size_t n = keys.size(), found = 0;
+	for ( size_t i = 0 ; i < n ; ++i )
+		out[i] = nullptr;
+	if ( _type != kObject )
+		return 0;
+	const RawObject &obj = RawObj();
+
+	#if VJSON_FLAT_OBJECT
+		// Each lookup is a probe with the precomputed hash (or for small
+		// objects, a scan of the hashes), which beats a pass over the items.
+		for ( size_t i = 0 ; i < n ; ++i )
+		{
+			auto it = obj.find( keys.KeyAt( i ) );
+			if ( it != obj.end() )
+			{
+				out[i] = &it->second;
+				++found;
+			}
+		}
+	#else
+		// Only a few keys, and a big object?  Separate lookups are cheaper
+		// than walking the whole thing.
+		size_t depth = 1;
+		while ( ( size_t(1) << depth ) < obj.size() )
+			++depth;
+		if ( n*depth < obj.size() )
+		{
+			for ( size_t i = 0 ; i < n ; ++i )
+			{
+				auto it = obj.find( KeyToFind( keys.KeyAt( i ) ) );
+				if ( it != obj.end() )
+				{
+					out[i] = &it->second;
+					++found;
+				}
+			}
+			return found;
+		}
+
+		// Walk the object and the keys together, both in sorted order
+		auto it = obj.begin();
+		for ( uint32_t i: keys._sorted )
+		{
+			const std::string &key = keys._keys[i];
+			int c = 1;
+			while ( it != obj.end() && ( c = CompareKeys( it->first.data(), it->first.length(), key.data(), key.length() ) ) < 0 )
+				++it;
+			if ( it == obj.end() )
+				break;
+			if ( c == 0 )
+			{
+				out[i] = &it->second;
+				++found;
+			}
+		}
+	#endif
+	return found;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Path
+//
+/////////////////////////////////////////////////////////////////////////////
+
+bool Path::Set( const char *pointer, size_t len )
+{
+	_steps.clear();
+	_valid = false;
+	const char *s = pointer, *end = pointer + len;
+	if ( s < end && *s != '/' )
+		return false;
+	while ( s < end )
+	{
+		++s; // Skip the '/'
+		Step step;
+		while ( s < end && *s != '/' )
+		{
+			if ( *s == '~' )
+			{
+				if ( s+1 >= end || ( s[1] != '0' && s[1] != '1' ) )
+				{
+					_steps.clear();
+					return false;
+				}
+				step.key.push_back( s[1] == '0' ? '~' : '/' );
+				s += 2;
+			}
+			else
+			{
+				step.key.push_back( *s++ );
+			}
+		}
+		step.hash = HashKey( step.key.c_str(), step.key.length() );
+
+		// Array index?  Decimal, with no leading zeros
+		const std::string &k = step.key;
+		step.index = std::string::npos;
+		if ( !k.empty() && k.length() < 19 && ( k[0] != '0' || k.length() == 1 ) )
+		{
+			size_t idx = 0, i = 0;
+			while ( i < k.length() && k[i] >= '0' && k[i] <= '9' )
+				idx = idx*10 + ( k[i++] - '0' );
+			if ( i == k.length() )
+				step.index = idx;
+		}
+		_steps.push_back( std::move( step ) );
+	}
+	_valid = true;
+	return true;
+}
+
+template <typename V>
+EResult Path::Walk( V &root, V **out ) const
+{
+	*out = nullptr;
+	if ( !_valid )
+		return kBadKey;
+	V *v = &root;
+	for ( const Step &step: _steps )
+	{
+		if ( v->IsObject() )
+		{
+			v = v->ValuePtrAtKey( step.AsKey() );
+			if ( !v )
+				return kBadKey;
+		}
+		else if ( v->IsArray() )
+		{
+			v = step.index == std::string::npos ? nullptr : v->ValuePtrAtIndex( step.index );
+			if ( !v )
+				return kBadIndex;
+		}
+		else
+		{
+			return step.index == std::string::npos ? kNotObject : kNotArray;
+		}
+	}
+	*out = v;
+	return kOK;
+}
+
+EResult Path::Resolve( const Value &root, const Value **out ) const { return Walk( root, out ); }
+EResult Path::Resolve( Value &root, Value **out ) const { return Walk( root, out ); }
+
+const Value *Value::ValuePtrAtPath( const Path &path ) const
+{
+	const Value *v;
+	path.Resolve( *this, &v );
+	return v;
+}
+
+Value *Value::ValuePtrAtPath( const Path &path )
+{
+	Value *v;
+	path.Resolve( *this, &v );
+	return v;
+}
+
+Value *Value::InternalAtPath( const Path &path, EValueType t ) const
+{
+	Value *v = const_cast<Value*>( ValuePtrAtPath( path ) );
+	return (v && v->_type == t) ? v : nullptr; 
+}
+
+#if VJSON_HAVE_CPP14
+
+Value LiteralValue::ToValue() const
+{
+	switch ( Type() )
+	{
+		case kObject:
+		{
+			Object result;
+			for ( LiteralMember item: Members() )
+				result[ item.first ] = item.second.ToValue();
+			return Value( std::move( result ) );
+		}
+
+		case kArray:
+		{
+			Array result;
+			result.Raw().reserve( ArraySize() );
+			for ( LiteralValue v: *this )
+				result.push_back( v.ToValue() );
+			return Value( std::move( result ) );
+		}
+
+		case kString:
+			return Value( std::string( AsCString( "" ), StringLen() ) );
+
+		case kDouble:
+			return Value( AsDouble( 0.0 ) );
+
+		case kBool:
+			return Value( AsBool( false ) );
+
+		default:
+			VJSON_ASSERT( false );
+		case kNull:
+			break;
+	}
+	return Value();
+}
+
+const LiteralNode *LiteralValue::FindIndexedKey( const char *key, size_t len ) const
+{
+	// Binary search the sorted keys
+	const uint32_t *lo = _index + _node->offset;
+	const uint32_t *hi = lo + _node->len;
+	while ( lo < hi )
+	{
+		const uint32_t *mid = lo + ( hi - lo ) / 2;
+		const LiteralNode *k = _node + *mid;
+		int c = CompareKeys( _chars + k->offset, k->len, key, len );
+		if ( c == 0 )
+			return k+1;
+		if ( c < 0 )
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return nullptr;
+}
+
+// Count up how much space we need to freeze a Value
+static void MeasureFrozen( const Value &x, size_t &nodes, size_t &chars, size_t &keys )
+{
+	++nodes;
+	switch ( x.Type() )
+	{
+		case kObject:
+			for ( const ObjectItem &item: x.GetObject() )
+			{
+				++nodes;
+				++keys;
+				chars += item.first.length() + 1;
+				MeasureFrozen( item.second, nodes, chars, keys );
+			}
+			break;
+
+		case kArray:
+			for ( const Value &v: x.GetArray() )
+				MeasureFrozen( v, nodes, chars, keys );
+			break;
+
+		case kString:
+			chars += x.GetString().length() + 1;
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void FreezeString( const std::string &s, std::vector<LiteralNode> &nodes, std::string &chars )
+{
+	LiteralNode n;
+	n.type = kString;
+	n.len = s.length();
+	n.offset = chars.length();
+	chars.append( s.c_str(), s.length() + 1 ); // Include the terminator
+	nodes.push_back( n );
+}
+
+// Finish off the object at nodes[idx], whose members are the last nodes:
+// add its keys to the index, sorted.  If a key is duplicated, the last one
+// wins, and the others are removed.  (Any objects inside them leave some
+// garbage in the index, but that should be rare.)
+static void FinishFrozenObject( std::vector<LiteralNode> &nodes, size_t idx, const std::string &chars, std::vector<uint32_t> &index )
+{
+	VJSON_ASSERT( nodes.size() - idx <= UINT32_MAX ); // Offsets in the index are 32 bits
+	size_t start = index.size();
+	for ( size_t k = idx+1 ; k < nodes.size() ; k += 1 + nodes[k+1].size )
+		index.push_back( uint32_t( k - idx ) );
+
+	// Sort by key.  Ties are broken by position, so that if a key is
+	// duplicated, the last one is at the end of the run
+	auto compare = [&]( uint32_t a, uint32_t b ) -> int
+	{
+		const LiteralNode &ka = nodes[idx+a], &kb = nodes[idx+b];
+		return CompareKeys( chars.data() + ka.offset, ka.len, chars.data() + kb.offset, kb.len );
+	};
+	std::sort( index.begin() + start, index.end(), [&]( uint32_t a, uint32_t b )
+	{
+		int c = compare( a, b );
+		return c ? c < 0 : a < b;
+	} );
+
+	// Remove duplicates, back to front so that the offsets stay valid
+	std::vector<uint32_t> dups;
+	for ( size_t i = start+1 ; i < index.size() ; ++i )
+	{
+		if ( compare( index[i-1], index[i] ) == 0 )
+			dups.push_back( index[i-1] );
+	}
+	if ( !dups.empty() )
+	{
+		std::sort( dups.begin(), dups.end() );
+		for ( size_t i = dups.size() ; i-- > 0 ; )
+		{
+			auto first = nodes.begin() + idx + dups[i];
+			nodes.erase( first, first + 1 + first[1].size );
+		}
+		index.resize( start );
+		for ( size_t k = idx+1 ; k < nodes.size() ; k += 1 + nodes[k+1].size )
+			index.push_back( uint32_t( k - idx ) );
+		std::sort( index.begin() + start, index.end(), [&]( uint32_t a, uint32_t b ) { return compare( a, b ) < 0; } );
+	}
+
+	nodes[idx].offset = start;
+	nodes[idx].len = index.size() - start;
+	nodes[idx].size = nodes.size() - idx;
+}
+
+static void FreezeValue( const Value &x, std::vector<LiteralNode> &nodes, std::string &chars, std::vector<uint32_t> &index )
+{
+	size_t idx = nodes.size();
+	switch ( x.Type() )
+	{
+		case kObject:
+			nodes.emplace_back();
+			nodes[idx].type = kObject;
+			for ( const ObjectItem &item: x.GetObject() )
+			{
+				FreezeString( item.first, nodes, chars );
+				FreezeValue( item.second, nodes, chars, index );
+			}
+			FinishFrozenObject( nodes, idx, chars, index );
+			break;
+
+		case kArray:
+			nodes.emplace_back();
+			nodes[idx].type = kArray;
+			nodes[idx].len = x.ArraySize();
+			for ( const Value &v: x.GetArray() )
+				FreezeValue( v, nodes, chars, index );
+			break;
+
+		case kString:
+			FreezeString( x.GetString(), nodes, chars );
+			break;
+
+		case kDouble:
+			nodes.emplace_back();
+			nodes[idx].type = kDouble;
+			nodes[idx].number = x.GetDouble();
+			break;
+
+		case kBool:
+			nodes.emplace_back();
+			nodes[idx].type = kBool;
+			nodes[idx].len = x.GetBool() ? 1 : 0;
+			break;
+
+		default:
+			VJSON_ASSERT( false );
+		case kNull:
+			nodes.emplace_back();
+			break;
+	}
+	nodes[idx].size = nodes.size() - idx;
+}
+
+void FrozenDocument::Freeze( const Value &x )
+{
+	size_t node_count = 0, char_count = 0, key_count = 0;
+	MeasureFrozen( x, node_count, char_count, key_count );
+	clear();
+	_nodes.reserve( node_count );
+	_chars.reserve( char_count );
+	_index.reserve( key_count );
+	FreezeValue( x, _nodes, _chars, _index );
+	VJSON_ASSERT( _nodes.size() == node_count && _chars.length() == char_count && _index.size() == key_count );
+}
+
+// Parse straight into the frozen format, without building a Value. Like
+// LiteralParser, we make two passes. The first pass (nodes is null) only
+// counts how much space we need, so that the second pass can fill in
+// buffers of exactly the right size.
+struct FrozenParser : Parser
+{
+	std::vector<LiteralNode> *const nodes;
+	std::string *const chars;
+	std::vector<uint32_t> *const index;
+
+	// What the first pass found we need.  (If there are duplicate keys,
+	// the second pass ends up using less.)
+	size_t nodes_needed = 0;
+	size_t chars_needed = 0;
+	size_t keys_needed = 0;
+
+	// Scratch space
+	std::string str;
+	Value number;
+
+	FrozenParser( ParseContext &c, const char *b, const char *e, std::vector<LiteralNode> *n, std::string *ch, std::vector<uint32_t> *i )
+	: Parser( c, b, e ), nodes( n ), chars( ch ), index( i ) {}
+
+	// Add a node, and return its position
+	size_t NewNode( EValueType type )
+	{
+		++nodes_needed;
+		if ( !nodes )
+			return 0;
+		nodes->emplace_back();
+		nodes->back().type = type;
+		return nodes->size() - 1;
+	}
+
+	// Add a node for the string in str
+	void NewString()
+	{
+		++nodes_needed;
+		chars_needed += str.length() + 1;
+		if ( nodes )
+			FreezeString( str, *nodes, *chars );
+	}
+
+	bool ParseFrozenObject()
+	{
+		size_t idx = NewNode( kObject );
+
+		// Peek first character, special case for empty object
+		SkipWhitespaceAndComments();
+		if ( !CheckEOF() )
+			return false;
+		if ( *ptr == '}' )
+			++ptr;
+		else for (;;)
+		{
+			// Key
+			if ( *ptr != '\"' )
+			{
+				Errorf( "Expected '\"' to begin JSON object key, but found '%c' (0x%02x) instead", *ptr, *ptr );
+				return false;
+			}
+			if ( !ParseQuotedString( str ) || !Alloc( sizeof(LiteralNode) + sizeof(uint32_t) ) )
+				return false;
+			if ( stats )
+				++stats->keys;
+			NewString();
+			++keys_needed;
+
+			// Locate and eat the colon
+			SkipWhitespaceAndComments();
+			if ( !CheckEOF() )
+				return false;
+			if ( *ptr != ':' )
+			{
+				Errorf( "Expected ':' but found '%c' (0x%02x) instead", *ptr, *ptr );
+				return false;
+			}
+			++ptr;
+
+			if ( !ParseFrozenValue() )
+				return false;
+
+			bool done = false;
+			if ( !ParseSeparator( '}', done ) )
+				return false;
+			if ( done )
+				break;
+		}
+
+		if ( nodes )
+			FinishFrozenObject( *nodes, idx, *chars, *index );
+		return true;
+	}
+
+	bool ParseFrozenArray()
+	{
+		size_t idx = NewNode( kArray );
+
+		// Peek first character, special case for empty array
+		SkipWhitespaceAndComments();
+		if ( !CheckEOF() )
+			return false;
+		size_t n = 0;
+		if ( *ptr == ']' )
+			++ptr;
+		else for (;;)
+		{
+			if ( !ParseFrozenValue() )
+				return false;
+			++n;
+
+			bool done = false;
+			if ( !ParseSeparator( ']', done ) )
+				return false;
+			if ( done )
+				break;
+		}
+
+		if ( nodes )
+		{
+			(*nodes)[idx].len = n;
+			(*nodes)[idx].size = nodes->size() - idx;
+		}
+		return true;
+	}
+
+	// Skip to the next value and parse it
+	bool ParseFrozenValue()
+	{
+		SkipWhitespaceAndComments();
+		if ( !CheckEOF() || !AddNode( 0 ) )
+			return false;
+
+		switch ( *ptr )
+		{
+			case '\"':
+				if ( stats )
+					++stats->strings;
+				if ( !ParseQuotedString( str ) )
+					return false;
+				NewString();
+				return true;
+
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+			case '-':
+			{
+				if ( !ParseNumber( number ) )
+					return false;
+				size_t idx = NewNode( kDouble );
+				if ( nodes )
+					(*nodes)[idx].number = number.GetDouble();
+				return true;
+			}
+
+			case '{':
+			{
+				if ( stats )
+					++stats->objects;
+				if ( !EnterContainer() )
+					return false;
+				++ptr;
+				bool ok = ParseFrozenObject();
+				--depth;
+				return ok;
+			}
+
+			case '[':
+			{
+				if ( stats )
+					++stats->arrays;
+				if ( !EnterContainer() )
+					return false;
+				++ptr;
+				bool ok = ParseFrozenArray();
+				--depth;
+				return ok;
+			}
+
+			case 't':
+				if ( ptr + 4 <= end && ptr[1] == 'r' && ptr[2] == 'u' && ptr[3] == 'e' )
+				{
+					size_t idx = NewNode( kBool );
+					if ( nodes )
+						(*nodes)[idx].len = 1;
+					ptr += 4;
+					if ( stats )
+						++stats->bools;
+					return true;
+				}
+				break;
+
+			case 'f':
+				if ( ptr + 5 <= end && ptr[1] == 'a' && ptr[2] == 'l' && ptr[3] == 's' && ptr[4] == 'e' )
+				{
+					NewNode( kBool );
+					ptr += 5;
+					if ( stats )
+						++stats->bools;
+					return true;
+				}
+				break;
+
+			case 'n':
+				if ( ptr + 4 <= end && ptr[1] == 'u' && ptr[2] == 'l' && ptr[3] == 'l' )
+				{
+					NewNode( kNull );
+					ptr += 4;
+					if ( stats )
+						++stats->nulls;
+					return true;
+				}
+				break;
+		}
+
+		// Unexpected here
+		Errorf( "Input starting with character '%c' (0x%02x) not a valid JSON value", *ptr, *ptr );
+		return false;
+	}
+
+	// Parse the whole input, which must be exactly one value
+	bool ParseFrozenDocument()
+	{
+		if ( ctx.max_input_bytes && size_t( end - begin ) > ctx.max_input_bytes )
+		{
+			LimitError( kParseInputTooLarge, "Input is larger than %llu bytes", ctx.max_input_bytes );
+			return false;
+		}
+		if ( !ParseFrozenValue() )
+			return false;
+
+		// Check for any extra characters
+		SkipWhitespaceAndComments();
+		int c = Peek();
+		if ( c < 0 )
+			return true;
+
+		Errorf( "Extra text starting with character 0x%02x='%c'", c, c );
+		return false;
+	}
+};
+
+bool FrozenDocument::ParseJSON( const char *begin, const char *end, ParseContext *ctx )
+{
+	VJSON_ASSERT( begin <= end );
+
+	// Trim off any trailing '\0's from the end
+	while ( end > begin && end[-1] == '\0' )
+		--end;
+
+	// Free the old document first, so we don't hold two at once
+	clear();
+
+	ParseContext dummy_ctx;
+	ParseContext &c = ctx ? *ctx : dummy_ctx;
+	std::chrono::steady_clock::time_point start;
+	if ( c.stats )
+		start = std::chrono::steady_clock::now();
+
+	// Measure, then parse for real.  (This resets the stats, so they
+	// describe only the second pass.  The time covers both.)
+	FrozenParser measure( c, begin, end, nullptr, nullptr, nullptr );
+	bool ok = measure.ParseFrozenDocument();
+	if ( ok )
+	{
+		_nodes.reserve( measure.nodes_needed );
+		_chars.reserve( measure.chars_needed );
+		_index.reserve( measure.keys_needed );
+		FrozenParser p( c, begin, end, &_nodes, &_chars, &_index );
+		ok = p.ParseFrozenDocument(); // Could still fail if cancelled, or past the deadline
+		VJSON_ASSERT( !ok || ( _nodes.size() <= measure.nodes_needed && _chars.length() <= measure.chars_needed && _index.size() <= measure.keys_needed ) );
+		if ( c.stats )
+			c.stats->bytes = size_t( p.ptr - begin );
+	}
+	if ( !ok )
+		clear();
+
+	if ( c.stats )
+		c.stats->total_time = std::chrono::steady_clock::now() - start;
+	return ok;
+}
+
+bool FrozenDocument::ParseFile( const char *filename, ParseContext *ctx )
+{
+	ParseContext dummy_ctx;
+	ParseContext &c = ctx ? *ctx : dummy_ctx;
+	MappedFile file;
+	if ( !file.Open( filename, c ) )
+	{
+		clear();
+		return false;
+	}
+	const char *data = file.data ? file.data : "";
+	return ParseJSON( data, data + file.size, &c );
+}
+
+#endif // #if VJSON_HAVE_CPP14
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// FrozenObject
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static inline uint64_t MixBits64( uint64_t x )
+{
+	x ^= x >> 33; x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+// 64-bit FNV-1a.  (HashKey is only 32 bits, and in a big table, two keys
+// with the same hash could never be separated.)  FNV leaves the top bits
+// poorly mixed for short keys, which we use to pick a bucket, so finish
+// it off with a mixer.
+static inline uint64_t HashKey64( const char *key, size_t len )
+{
+	uint64_t h = 14695981039346656037ull;
+	for ( size_t i = 0 ; i < len ; ++i )
+	{
+		h ^= (unsigned char)key[i];
+		h *= 1099511628211ull;
+	}
+	return MixBits64( h );
+}
+
+// Which bucket a key belongs to.  Uses the top half of the hash
+static inline size_t FrozenBucket( uint64_t hash, size_t bucket_count )
+{
+	return size_t( ( ( hash >> 32 ) * bucket_count ) >> 32 );
+}
+
+// Which slot a key goes in, given its bucket's seed
+static inline size_t FrozenSlot( uint64_t hash, uint32_t seed, size_t n )
+{
+	uint64_t x = MixBits64( hash ^ ( seed * 0x9E3779B97F4A7C15ull ) );
+	return size_t( ( ( x & 0xffffffff ) * n ) >> 32 );
+}
+
+FrozenObject::FrozenObject( const Object &obj )
+{
+	_items.reserve( obj.size() );
+	for ( const ObjectItem &item: obj )
+		_items.emplace_back( item.first, item.second );
+	Build();
+}
+
+FrozenObject::FrozenObject( Object &&obj )
+{
+	_items.reserve( obj.size() );
+	for ( ObjectItem &item: obj )
+		_items.emplace_back( item.first, std::move( item.second ) );
+	obj.clear();
+	Build();
+}
+
+FrozenObject Object::Freeze()
+{
+	return FrozenObject( std::move( *this ) );
+}
+
+Object FrozenObject::Thaw()
+{
+	Object result;
+	for ( value_type &item: _items )
+		result[ std::move( item.first ) ] = std::move( item.second );
+	_items.clear();
+	_hashes.clear();
+	_seeds.clear();
+	_linear = false;
+	return result;
+}
+
+void FrozenObject::Build()
+{
+	size_t n = _items.size();
+	_hashes.resize( n );
+	for ( size_t i = 0 ; i < n ; ++i )
+		_hashes[i] = HashKey64( _items[i].first.c_str(), _items[i].first.length() );
+	_seeds.clear();
+	_linear = false;
+	if ( n == 0 )
+		return;
+
+	// Two keys with the same hash will always land in the same slot.  This
+	// is astronomically unlikely, but don't spin forever on it.
+	{
+		std::vector<uint64_t> sorted( _hashes );
+		std::sort( sorted.begin(), sorted.end() );
+		if ( std::adjacent_find( sorted.begin(), sorted.end() ) != sorted.end() )
+		{
+			_linear = true;
+			return;
+		}
+	}
+
+	// Hash and displace.  Put the keys into buckets of about four keys each.
+	// Then, biggest bucket first, search for a seed that sends all of the
+	// bucket's keys to free slots.  The last buckets have only a few free
+	// slots to choose from, so give up on a bucket only after many tries,
+	// and then start over with more buckets.
+	std::vector<uint32_t> slot_of( n );
+	const uint32_t max_seed = uint32_t( std::max<size_t>( n, 1024 ) * 64 );
+	for ( size_t bucket_count = ( n + 3 ) / 4 ; ; bucket_count *= 2 )
+	{
+		if ( bucket_count > n*8 )
+		{
+			_seeds.clear();
+			_linear = true;
+			return;
+		}
+
+		std::vector<std::vector<uint32_t>> buckets( bucket_count );
+		for ( size_t i = 0 ; i < n ; ++i )
+			buckets[ FrozenBucket( _hashes[i], bucket_count ) ].push_back( uint32_t( i ) );
+		std::vector<uint32_t> order( bucket_count );
+		for ( size_t b = 0 ; b < bucket_count ; ++b )
+			order[b] = uint32_t( b );
+		std::stable_sort( order.begin(), order.end(), [&buckets]( uint32_t a, uint32_t b ) { return buckets[a].size() > buckets[b].size(); } );
+
+		std::vector<bool> taken( n );
+		_seeds.assign( bucket_count, 0 );
+		bool ok = true;
+		for ( uint32_t b: order )
+		{
+			const std::vector<uint32_t> &keys = buckets[b];
+			if ( keys.empty() )
+				break; // The rest are empty, too
+			uint32_t seed = 0;
+			for (;;)
+			{
+				size_t k = 0;
+				while ( k < keys.size() )
+				{
+					size_t slot = FrozenSlot( _hashes[ keys[k] ], seed, n );
+					if ( taken[ slot ] )
+						break;
+					taken[ slot ] = true;
+					slot_of[ keys[k] ] = uint32_t( slot );
+					++k;
+				}
+				if ( k == keys.size() )
+					break;
+				while ( k-- > 0 )
+					taken[ slot_of[ keys[k] ] ] = false;
+				if ( ++seed > max_seed )
+				{
+					ok = false;
+					break;
+				}
+			}
+			if ( !ok )
+				break;
+			_seeds[b] = seed;
+		}
+		if ( ok )
+			break;
+	}
+
+	// Put everything in its slot
+	std::vector<value_type> items( n );
+	std::vector<uint64_t> hashes( n );
+	for ( size_t i = 0 ; i < n ; ++i )
+	{
+		items[ slot_of[i] ] = std::move( _items[i] );
+		hashes[ slot_of[i] ] = _hashes[i];
+	}
+	_items.swap( items );
+	_hashes.swap( hashes );
+}
+
+const Value *FrozenObject::Find( const char *key, size_t len ) const
+{
+	if ( _items.empty() )
+		return nullptr;
+	uint64_t h = HashKey64( key, len );
+	if ( _linear )
+	{
+		for ( size_t i = 0 ; i < _items.size() ; ++i )
+		{
+			if ( _hashes[i] == h && _items[i].first.length() == len && memcmp( _items[i].first.data(), key, len ) == 0 )
+				return &_items[i].second;
+		}
+		return nullptr;
+	}
+	size_t i = FrozenSlot( h, _seeds[ FrozenBucket( h, _seeds.size() ) ], _items.size() );
+	const value_type &item = _items[i];
+	if ( _hashes[i] == h && item.first.length() == len && memcmp( item.first.data(), key, len ) == 0 )
+		return &item.second;
+	return nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// ArrayIndex
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#if !VJSON_HAVE_CPP17
+	constexpr size_t ArrayIndex::npos;
+#endif
+
+size_t ArrayIndex::IndexKeyHash::operator()( const IndexKey &k ) const
+{
+	return (size_t)( k.numeric ? MixBits64( k.number ) : HashKey64( k.str.data(), k.str.length() ) );
+}
+
+void ArrayIndex::MakeKey( const char *id, size_t len, IndexKey &out )
+{
+	// All digits, and not too many to fit?  Then it's a number
+	out.number = 0;
+	out.numeric = len > 0 && len < 20;
+	for ( size_t i = 0 ; out.numeric && i < len ; ++i )
+	{
+		if ( id[i] < '0' || id[i] > '9' )
+			out.numeric = false;
+		else
+			out.number = out.number*10 + ( id[i] - '0' );
+	}
+	if ( out.numeric )
+	{
+		out.str.clear();
+	}
+	else
+	{
+		out.number = 0;
+		out.str.assign( id, len );
+	}
+}
+
+bool ArrayIndex::MakeKey( const Value &id, IndexKey &out )
+{
+	switch ( id.Type() )
+	{
+		case kString:
+		{
+			const std::string &s = id.AsString( "" );
+			MakeKey( s.data(), s.length(), out );
+			return true;
+		}
+
+		case kDouble:
+		{
+			// Integers are numbers.  Anything else is the string we get from
+			// TryInterpret, same as a string holding that text would be
+			double x = id.AsDouble( 0.0 );
+			if ( x >= 0.0 && x < (double)( 1ULL << 53 ) && (double)(uint64_t)x == x )
+			{
+				out.numeric = true;
+				out.number = (uint64_t)x;
+				out.str.clear();
+				return true;
+			}
+			break;
+		}
+
+		case kBool:
+			break;
+
+		default:
+			return false;
+	}
+
+	std::string s;
+	if ( id.TryInterpret( s ) != kOK )
+		return false;
+	MakeKey( s.data(), s.length(), out );
+	return true;
+}
+
+bool ArrayIndex::KeyOfElement( size_t idx, IndexKey &out ) const
+{
+	const Value *v;
+	if ( _path.Resolve( (*_arr)[ idx ], &v ) != kOK )
+		return false;
+	return MakeKey( *v, out );
+}
+
+void ArrayIndex::Add( size_t idx )
+{
+	IndexKey key;
+	if ( !KeyOfElement( idx, key ) )
+		return;
+	auto ins = _map.emplace( std::move( key ), idx );
+	if ( !ins.second && idx < ins.first->second )
+		ins.first->second = idx; // The first one wins
+}
+
+void ArrayIndex::Rebuild()
+{
+	_map.clear();
+	size_t n = _arr->size();
+	_map.reserve( n );
+	for ( size_t i = 0 ; i < n ; ++i )
+		Add( i );
+	_indexed = n;
+	_epoch = _arr->_epoch;
+}
+
+void ArrayIndex::Sync()
+{
+	size_t n = _arr->size();
+	if ( _arr->_epoch != _epoch || n < _indexed )
+	{
+		Rebuild();
+		return;
+	}
+
+	// Appended since last time
+	for ( size_t i = _indexed ; i < n ; ++i )
+		Add( i );
+	_indexed = n;
+}
+
+void ArrayIndex::Update( size_t idx )
+{
+	Sync();
+	if ( idx < _indexed )
+		Add( idx );
+}
+
+size_t ArrayIndex::Scan( const IndexKey &key, size_t first ) const
+{
+	IndexKey check;
+	size_t n = _arr->size();
+	for ( size_t i = first ; i < n ; ++i )
+	{
+		if ( KeyOfElement( i, check ) && check == key )
+			return i;
+	}
+	return npos;
+}
+
+size_t ArrayIndex::Lookup( const IndexKey &key ) const
+{
+	// Changed since we last synced, other than by appending?  Then we
+	// can't trust any of it
+	if ( _arr->_epoch != _epoch || _arr->size() < _indexed )
+		return Scan( key, 0 );
+
+	auto it = _map.find( key );
+	if ( it == _map.end() )
+		return Scan( key, _indexed ); // Anything appended since we synced?
+
+	// Make sure it still has this ID.  It might have been changed in a way
+	// the array couldn't see
+	IndexKey check;
+	if ( KeyOfElement( it->second, check ) && check == key )
+		return it->second;
+	return Scan( key, 0 );
+}
+
+size_t ArrayIndex::IndexOf( const Value &id ) const
+{
+	IndexKey key;
+	if ( !MakeKey( id, key ) )
+		return npos;
+	return Lookup( key );
+}
+
+size_t ArrayIndex::IndexOf( const char *id ) const
+{
+	IndexKey key;
+	MakeKey( id, strlen( id ), key );
+	return Lookup( key );
+}
+
 //bool Array::ParseJSON( const char *begin, const char *end, ParseContext *ctx )
 //{
-//	if ( InternalParseTyped( *this, begin, end, ctx, kArray, "array" ) )
+//	if ( Value::ParseJSON( begin, end, ctx ) && InternalCheckType( *this, ctx, kArray, "array" ) )
 //		return true;
 //	SetEmptyArray(); // Type safety in case caller reuses
 //	return false;
@@ -1709,15 +4313,24 @@ void Value::Validate( CValidator &validator, const char *pchName ) const
 			break;
 
 		case kObject:
-			ValidateRecursive( _object );
+			#if VJSON_COMPACT_VALUE
+				validator.ClaimMemory( _object );
+			#endif
+			ValidateRecursive( RawObj() );
 			break;
 
 		case kArray:
-			ValidateRecursive( _array );
+			#if VJSON_COMPACT_VALUE
+				validator.ClaimMemory( _array );
+			#endif
+			ValidateRecursive( RawArr() );
 			break;
 
 		case kString:
-			ValidateRecursive( _string );
+			#if VJSON_COMPACT_VALUE
+				validator.ClaimMemory( _string );
+			#endif
+			ValidateRecursive( RawStr() );
 			break;
 	}
 }
@@ -16,6 +16,14 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_set>
+#include <unordered_map>
+#include <tuple>
+#include <functional>
+#include <type_traits>
 
 // @VALVE Memory validation, etc
 #include <tier0/dbg.h>
@@ -36,6 +44,78 @@
 	#define VJSON_ASSERT assert
 #endif
 
+// Detect C++17. (MSVC doesn't set __cplusplus properly without /Zc:__cplusplus)
+#ifndef VJSON_HAVE_CPP17
+	#if __cplusplus >= 201703L || ( defined(_MSVC_LANG) && _MSVC_LANG >= 201703L )
+		#define VJSON_HAVE_CPP17 1
+	#else
+		#define VJSON_HAVE_CPP17 0
+	#endif
+#endif
+#if VJSON_HAVE_CPP17
+	#include <string_view>
+#endif
+
+// Detect C++14. Compile-time JSON literals (and FrozenDocument, which
+// shares their format) and TupleAtKeys need it. Everything else only
+// needs C++11. VJSON_CONSTEXPR14 marks functions that can only be
+// constexpr with C++14's relaxed rules.
+#ifndef VJSON_HAVE_CPP14
+	#if __cplusplus >= 201402L || ( defined(_MSVC_LANG) && _MSVC_LANG >= 201402L )
+		#define VJSON_HAVE_CPP14 1
+	#else
+		#define VJSON_HAVE_CPP14 0
+	#endif
+#endif
+#if VJSON_HAVE_CPP14
+	#define VJSON_CONSTEXPR14 constexpr
+#else
+	#define VJSON_CONSTEXPR14 inline
+#endif
+
+// Define VJSON_COMPACT_VALUE to 1 to use a compact memory layout, where
+// a Value is 16 bytes instead of ~56. Strings, objects, and arrays are
+// stored on the heap, and the Value holds a pointer. This is a big savings
+// for numbers, bools, and null, and for arrays of them, but it costs an
+// extra allocation per string and aggregate. The API is the same either way,
+// except that a Value that has been moved from is left null.
+#ifndef VJSON_COMPACT_VALUE
+	#if defined( VJSON_COPY_ON_WRITE ) && VJSON_COPY_ON_WRITE
+		#define VJSON_COMPACT_VALUE 1
+	#else
+		#define VJSON_COMPACT_VALUE 0
+	#endif
+#endif
+
+// Define VJSON_COPY_ON_WRITE to 1 to make copies of a Value share their
+// strings, objects, and arrays, so copying is O(1). When you modify a copy,
+// only the containers on the path down to the thing that changed are
+// actually copied. A shared value is never modified in place, so const
+// access to a Value is safe while other threads modify their own copies.
+// This requires (and turns on) VJSON_COMPACT_VALUE.
+//
+// The catch is that any *non-const* access to a container counts as a
+// modification, and it invalidates pointers and references you got
+// earlier from that container. Also, don't hang onto a mutable pointer or
+// reference into a Value, and then make a copy and write through it,
+// because the write will show up in both copies.
+#ifndef VJSON_COPY_ON_WRITE
+	#define VJSON_COPY_ON_WRITE 0
+#endif
+#if VJSON_COPY_ON_WRITE && !VJSON_COMPACT_VALUE
+	#error "VJSON_COPY_ON_WRITE requires VJSON_COMPACT_VALUE"
+#endif
+
+// Define VJSON_FLAT_OBJECT to 1 to store objects in a FlatObject instead
+// of a std::map. Members are kept in a contiguous array, searched linearly
+// when the object is small, with a hash index once it gets bigger. This is
+// much faster (and smaller) for the typical object with a handful of keys,
+// but note that members are iterated and printed in the order they were
+// added, not sorted.
+#ifndef VJSON_FLAT_OBJECT
+	#define VJSON_FLAT_OBJECT 0
+#endif
+
 // Default printing options.
 #ifndef VJSON_DEFAULT_INDENT
 	#define VJSON_DEFAULT_INDENT "\t"
@@ -70,38 +150,298 @@ enum EResult
 	kBadKey, // Key not found in object
 };
 
+// Reasons that parsing can fail. See ParseContext::error
+enum EParseError
+{
+	kParseOK,
+	kParseSyntaxError, // The input is not valid JSON
+	kParseWrongType, // Valid JSON, but not the type requested. (E.g. Object::ParseJSON got an array)
+	kParseInputTooLarge, // Exceeded ParseContext::max_input_bytes
+	kParseTooManyNodes, // Exceeded ParseContext::max_nodes
+	kParseStringTooLong, // Exceeded ParseContext::max_string_length
+	kParseAllocBudget, // Exceeded ParseContext::max_alloc_bytes
+	kParseTooDeep, // Exceeded ParseContext::max_depth
+	kParseDeadline, // ParseContext::deadline passed
+	kParseCancelled, // ParseContext::cancel was set
+	kParseFileError, // ParseFile couldn't open or map the file
+};
+
+// Hash function used for object keys. (FNV-1a)
+VJSON_CONSTEXPR14 uint32_t HashKey( const char *key, size_t len )
+{
+	uint32_t h = 2166136261u;
+	for ( size_t i = 0 ; i < len ; ++i )
+		h = ( h ^ (uint8_t)key[i] ) * 16777619u;
+	return h;
+}
+
+// An object key with its length and hash worked out ahead of time, for
+// fast repeated lookups. You can pass a Key anywhere a key is expected.
+// A Key doesn't own the string, so get one from a KeyTable, or make one
+// for a string that outlives it, such as a string literal.
+struct Key
+{
+	const char *str = "";
+	size_t len = 0;
+	uint32_t hash = 2166136261u; // HashKey( "", 0 )
+
+	constexpr Key() {}
+	explicit Key( const char *s ) : Key( s, strlen( s ) ) {}
+	VJSON_CONSTEXPR14 Key( const char *s, size_t l ) : str( s ), len( l ), hash( HashKey( s, l ) ) {}
+
+	constexpr const char *c_str() const { return str; }
+	constexpr size_t length() const { return len; }
+};
+
+// Key literals. The length and hash are worked out at compile time.
+// (With C++11, at runtime.)
+// Example:
+//
+// using namespace vjson::literals;
+// const char *name = doc.CStringAtKey( "name"_vk, "" );
+// static constexpr vjson::Key kUser = "user"_vk;
+inline namespace literals
+{
+	VJSON_CONSTEXPR14 Key operator""_vk( const char *str, size_t len ) { return Key( str, len ); }
+}
+
+// A Key that remembers which member it matched last time. Objects that
+// were built the same way (such as records parsed from the same kind of
+// document) have the same "shape": the same keys, in the same order. So
+// with VJSON_FLAT_OBJECT, looking up a CachedKey in one object after
+// another usually goes straight to the right member with one comparison.
+// (Without VJSON_FLAT_OBJECT, it's just a Key.) It's fine to share one
+// between threads.
+class CachedKey : public Key
+{
+public:
+	explicit CachedKey( const char *s ) : Key( s ) {}
+	CachedKey( const char *s, size_t l ) : Key( s, l ) {}
+	explicit CachedKey( const Key &k ) : Key( k ) {}
+	CachedKey( const CachedKey &x ) : Key( x ), _slot( x._slot.load( std::memory_order_relaxed ) ) {}
+
+private:
+	friend class Value;
+	mutable std::atomic<uint32_t> _slot{0}; // Where we found it last time
+};
+
+// A set of keys to look up all at once. See Value::ValuePtrsAtKeys.
+// Build it once and reuse it.
+//
+// static const vjson::KeySet kKeys{ "host", "port", "tls" };
+class KeySet
+{
+public:
+	KeySet( std::initializer_list<const char *> keys );
+	explicit KeySet( const std::vector<std::string> &keys );
+
+	size_t size() const { return _keys.size(); }
+	Key KeyAt( size_t i ) const { Key k; k.str = _keys[i].c_str(); k.len = _keys[i].length(); k.hash = _hashes[i]; return k; }
+
+private:
+	friend class Value;
+	void Init();
+	std::vector<std::string> _keys; // In the order given
+	std::vector<uint32_t> _hashes;
+	std::vector<uint32_t> _sorted; // Indices into _keys, in the order that objects sort keys
+};
+
 // Internal implementation details. Nothing to see here, move along...
-class Value; class Object; class Array;
-struct PrintOptions; struct ParseContext;
+class Value; class Object; class Array; class Path; class ArrayBuilder;
+struct PrintOptions; struct ParseContext; struct ParseStats; struct MemoryStats; struct NumberStats;
+inline int CompareKeys( const char *l, size_t llen, const char *r, size_t rlen )
+{
+	int c = memcmp( l, r, llen < rlen ? llen : rlen );
+	return c ? c : ( llen < rlen ? -1 : llen > rlen ? 1 : 0 );
+}
 struct ObjectKeyLess
 {
-	bool operator()( const std::string &l, const std::string &r ) const { return strcmp( l.c_str(), r.c_str() ) < 0; }
-
 	// With C++14, we don't need to make a copy of the key to do lookup,
 	// so long as the comparator can compare the types.
-	bool operator()( const std::string &l, const char *r ) const { return strcmp( l.c_str(), r ) < 0; }
-	bool operator()( const char *l, const std::string &r ) const { return strcmp( l, r.c_str() ) < 0; }
-
-	// FIXME string_view?
+	typedef void is_transparent;
+
+	// Keys are ordered by their bytes, same as strcmp, except that
+	// embedded nulls are allowed
+	bool operator()( const std::string &l, const std::string &r ) const { return CompareKeys( l.data(), l.length(), r.data(), r.length() ) < 0; }
+	bool operator()( const std::string &l, const char *r ) const { return CompareKeys( l.data(), l.length(), r, strlen( r ) ) < 0; }
+	bool operator()( const char *l, const std::string &r ) const { return CompareKeys( l, strlen( l ), r.data(), r.length() ) < 0; }
+	bool operator()( const std::string &l, const Key &r ) const { return CompareKeys( l.data(), l.length(), r.str, r.len ) < 0; }
+	bool operator()( const Key &l, const std::string &r ) const { return CompareKeys( l.str, l.len, r.data(), r.length() ) < 0; }
+	#if VJSON_HAVE_CPP17
+		bool operator()( const std::string &l, std::string_view r ) const { return CompareKeys( l.data(), l.length(), r.data(), r.length() ) < 0; }
+		bool operator()( std::string_view l, const std::string &r ) const { return CompareKeys( l.data(), l.length(), r.data(), r.length() ) < 0; }
+	#endif
 };
-using RawObject = std::map<std::string, Value, ObjectKeyLess>; // Internal storage for for objects.
+
+// Keys in a form that can be used to insert into an object
+inline const char *KeyToInsert( const char *key ) { return key; }
+inline const std::string &KeyToInsert( const std::string &key ) { return key; }
+inline std::string &&KeyToInsert( std::string &&key ) { return std::move( key ); }
+inline std::string KeyToInsert( const Key &key ) { return std::string( key.str, key.len ); }
+#if VJSON_HAVE_CPP17
+	inline std::string KeyToInsert( std::string_view key ) { return std::string( key ); }
+#endif
+
+// Keys in a form that can be used to find in an object.  Before C++14,
+// std::map can only find its own key type, so a Key gets copied.
+#if VJSON_HAVE_CPP14 || VJSON_FLAT_OBJECT
+	template <typename K> const K &KeyToFind( const K &key ) { return key; }
+#else
+	inline const char *KeyToFind( const char *key ) { return key; }
+	inline const std::string &KeyToFind( const std::string &key ) { return key; }
+	inline std::string KeyToFind( const Key &key ) { return std::string( key.str, key.len ); }
+#endif
+
+#if VJSON_FLAT_OBJECT
+	class FlatObject;
+	using RawObject = FlatObject; // Internal storage for for objects.
+#else
+	using RawObject = std::map<std::string, Value, ObjectKeyLess>; // Internal storage for for objects.
+#endif
 using RawArray = std::vector<Value>; // Internal storage for arrays
+
+// Moving a Value moves the container inside it, and std::map's move
+// constructor may allocate (MSVC's gives the source a new sentinel node),
+// so moves are only noexcept when the object storage is. (With
+// VJSON_COMPACT_VALUE, a move just steals a pointer.)
+#if VJSON_COMPACT_VALUE
+	#define VJSON_MOVE_NOEXCEPT noexcept
+#else
+	#define VJSON_MOVE_NOEXCEPT noexcept( std::is_nothrow_move_constructible<::vjson::RawObject>::value )
+#endif
+#if VJSON_COPY_ON_WRITE
+
+// With VJSON_COPY_ON_WRITE, strings and containers live in one of these,
+// shared by all of the copies of a Value.
+template <typename T>
+struct SharedBox
+{
+	std::atomic<int> refs{1};
+	T value;
+
+	SharedBox() {}
+	template <typename A> explicit SharedBox( A &&a ) : value( std::forward<A>( a ) ) {}
+};
+
+template <typename T> inline void ReleaseBox( SharedBox<T> *box )
+{
+	if ( box->refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+		delete box;
+}
+
+// Get ready to modify the contents. If anybody else can see the box,
+// then make our own copy first.
+template <typename T> inline T &UnshareBox( SharedBox<T> *&box )
+{
+	if ( box->refs.load( std::memory_order_acquire ) != 1 )
+	{
+		SharedBox<T> *copy = new SharedBox<T>( box->value );
+		ReleaseBox( box );
+		box = copy;
+	}
+	return box->value;
+}
+#endif
+
+#if VJSON_FLAT_OBJECT
+
+// Storage for objects when VJSON_FLAT_OBJECT is set. It has the parts of the
+// std::map interface that we (and most callers) actually use, but:
+// - Members are iterated in the order they were added.
+// - Like std::vector, adding or erasing a member invalidates iterators
+//   and pointers to the members.
+// - The key is not const, but don't change it through an iterator!
+// - Erasing from a big object rebuilds the hash index, so it's O(n).
+class FlatObject
+{
+public:
+	using key_type = std::string;
+	using mapped_type = Value;
+	using value_type = std::pair<std::string, Value>;
+	using iterator = std::vector<value_type>::iterator;
+	using const_iterator = std::vector<value_type>::const_iterator;
+
+	// Objects with more members than this get a hash index
+	static constexpr size_t kMaxLinear = 8;
+
+	inline size_t size() const;
+	inline bool empty() const;
+	inline size_t capacity() const;
+	inline void reserve( size_t n );
+	inline void shrink_to_fit();
+	inline size_t index_bytes() const; // Memory used for the hashes and the index
+	inline void clear();
+	inline void swap( FlatObject &x );
+
+	inline iterator begin();
+	inline iterator end();
+	inline const_iterator begin() const;
+	inline const_iterator end() const;
+
+	iterator       find( const char *key )              { return find( Key( key ) ); }
+	const_iterator find( const char *key ) const        { return find( Key( key ) ); }
+	iterator       find( const std::string &key )       { return find( Key( key.c_str(), key.length() ) ); }
+	const_iterator find( const std::string &key ) const { return find( Key( key.c_str(), key.length() ) ); }
+	iterator       find( const Key &key );
+	const_iterator find( const Key &key ) const         { return const_cast<FlatObject*>( this )->find( key ); }
+	#if VJSON_HAVE_CPP17
+		iterator       find( std::string_view key )       { return find( Key( key.data(), key.size() ) ); }
+		const_iterator find( std::string_view key ) const { return find( Key( key.data(), key.size() ) ); }
+	#endif
+	template <typename K> size_t count( K &&key ) const { return find( key ) == end() ? 0 : 1; }
+
+	// Find the value at the key, adding a null value if not found
+	Value &operator[]( const char *key );
+	Value &operator[]( const std::string &key );
+	Value &operator[]( std::string &&key );
+
+	// Add a member, constructing the value in place from args. The key must
+	// not be present already. (The caller checks.) hash is HashKey( key ).
+	template <typename... A> Value &emplace_new( std::string &&key, uint32_t hash, A&&... args );
+
+	// Remove a member. Returns the number of members removed (0 or 1)
+	size_t erase( const char *key );
+	size_t erase( const std::string &key );
+	iterator erase( const_iterator pos );
+
+private:
+	std::vector<value_type> _entries;
+	std::vector<uint32_t> _hashes; // Hash of each key, parallel to _entries
+	std::vector<uint32_t> _index; // Open addressing, entry index+1. (0=empty slot.) Empty if we are small
+	Value &InternalAdd( std::string &&key, uint32_t hash );
+	void IndexAdded();
+	void IndexEntry( size_t idx );
+	void Reindex();
+};
+#endif
 using ObjectItem = RawObject::value_type; // A.k.a. std::pair<const std::string,Value>. You'll get a reference to this when you iterate an Object
+class LiteralValue; struct LiteralMember; class FrozenObject;
 template<typename T> struct TypeTraits {};
-template<> struct TypeTraits<std::nullptr_t> { static constexpr EValueType kType = kNull; using AsReturnType = void; using AsReturnTypeConst = void; };
-template<> struct TypeTraits<bool> { static constexpr EValueType kType = kBool; using AsReturnType = bool&; using AsReturnTypeConst = const bool&; };
-template<> struct TypeTraits<double> { static constexpr EValueType kType = kDouble; using AsReturnType = double&; using AsReturnTypeConst = const double&; };
-template<> struct TypeTraits<int> { static constexpr EValueType kType = kNumber; using AsReturnType = int; using AsReturnTypeConst = int; };
-template<> struct TypeTraits<const char *> { static constexpr EValueType kType = kString; using AsReturnType = const char *; using AsReturnTypeConst = const char *; };
-template<> struct TypeTraits<std::string> { static constexpr EValueType kType = kString; using AsReturnType = std::string &; using AsReturnTypeConst = const std::string &; };
-template<> struct TypeTraits<Object> { static constexpr EValueType kType = kObject; using AsReturnType = Object &; using AsReturnTypeConst = const Object &; };
-template<> struct TypeTraits<Array> { static constexpr EValueType kType = kArray; using AsReturnType = Array &; using AsReturnTypeConst = const Array &; };
+template<> struct TypeTraits<std::nullptr_t> { static constexpr EValueType kType = kNull; using AsReturnType = void; using AsReturnTypeConst = void; using LiteralType = void; };
+template<> struct TypeTraits<bool> { static constexpr EValueType kType = kBool; using AsReturnType = bool&; using AsReturnTypeConst = const bool&; using LiteralType = bool; };
+template<> struct TypeTraits<double> { static constexpr EValueType kType = kDouble; using AsReturnType = double&; using AsReturnTypeConst = const double&; using LiteralType = double; };
+template<> struct TypeTraits<int> { static constexpr EValueType kType = kNumber; using AsReturnType = int; using AsReturnTypeConst = int; using LiteralType = int; };
+template<> struct TypeTraits<const char *> { static constexpr EValueType kType = kString; using AsReturnType = const char *; using AsReturnTypeConst = const char *; using LiteralType = const char *; };
+template<> struct TypeTraits<std::string> { static constexpr EValueType kType = kString; using AsReturnType = std::string &; using AsReturnTypeConst = const std::string &; using LiteralType = std::string; };
+template<> struct TypeTraits<Object> { static constexpr EValueType kType = kObject; using AsReturnType = Object &; using AsReturnTypeConst = const Object &; using LiteralType = LiteralValue; };
+template<> struct TypeTraits<Array> { static constexpr EValueType kType = kArray; using AsReturnType = Array &; using AsReturnTypeConst = const Array &; using LiteralType = LiteralValue; };
 template<typename T, typename V, typename A, typename R> struct ArrayIter;
 template<typename T> using ConstArrayIter = ArrayIter<T, const Value, const RawArray, typename TypeTraits<T>::AsReturnTypeConst >;
 template<typename T> using MutableArrayIter = ArrayIter<T, Value, RawArray, typename TypeTraits<T>::AsReturnType >;
 template<typename T, typename A, typename I> struct ArrayRange;
 template<typename T> using ConstArrayRange = ArrayRange< T, const RawArray, ConstArrayIter<T> >;
 template<typename T> using MutableArrayRange = ArrayRange< T, RawArray, MutableArrayIter<T> >;
+template<typename T> class StridedSpan;
+template<typename T> struct LiteralIter;
+template<typename T> struct LiteralRange;
+struct LiteralNode // Compile-time documents are a flat list of these. See VJSON_LITERAL
+{
+	EValueType type = kNull;
+	size_t size = 1; // Number of nodes in this subtree, including this one
+	size_t len = 0; // Object: number of key/value pairs. Array: number of elements. String: length in bytes. Bool: 0 or 1
+	size_t offset = 0; // String: offset of the first character in the character buffer. Object in a FrozenDocument: offset of its key index
+	double number = 0.0;
+};
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -119,6 +459,63 @@ struct PrintOptions
 	const char *indent = VJSON_DEFAULT_INDENT;
 };
 
+// What it cost to parse a document. See ParseContext::stats
+struct ParseStats
+{
+	size_t bytes = 0; // Input bytes consumed. (If parsing failed, up to the error)
+	size_t objects = 0;
+	size_t arrays = 0;
+	size_t strings = 0; // Not including keys
+	size_t numbers = 0;
+	size_t bools = 0;
+	size_t nulls = 0;
+	size_t keys = 0;
+	size_t escaped_strings = 0; // Strings and keys that contained escape sequences
+	size_t string_bytes = 0; // Total length of all strings and keys, after decoding escapes
+	int max_depth = 0;
+
+	// Heap allocations made while parsing, and their size. We can't see
+	// inside the STL, so these are worked out from vector and string
+	// capacity changes and map node insertions, and the byte count does
+	// not include allocator overhead. Close, but not exact.
+	size_t allocs = 0;
+	size_t alloc_bytes = 0;
+
+	// Wall clock time. build_time is time spent creating and filling
+	// in the DOM (allocating, inserting, copying string data.) The rest of
+	// the time (total_time - build_time) was spent scanning the input.
+	// NOTE: collecting the time split reads the clock a *lot*, so turn this
+	// on only when you need it.
+	bool measure_build_time = false;
+	std::chrono::nanoseconds total_time{0};
+	std::chrono::nanoseconds build_time{0};
+};
+
+// How much memory a Value tree uses, in bytes. See Value::MemoryUsage().
+// Like ParseStats, this is worked out from sizes and capacities, since we
+// can't see inside the STL, and allocator overhead isn't included.
+struct MemoryStats
+{
+	size_t values = 0; // The Values themselves, including the root
+	size_t keys = 0; // Object keys too long to be stored inside the std::string
+	size_t strings = 0; // String values too long to be stored inside the std::string
+	size_t overhead = 0; // Map nodes, key string objects, flat object hashes and index, and heap boxes for compact values
+	size_t slack = 0; // Capacity that is allocated, but not used. Value::Compact() gets it back
+
+	size_t total() const { return values + keys + strings + overhead + slack; }
+};
+
+// Sum, min and max of the numbers in an array. See Array::Summarize()
+struct NumberStats
+{
+	size_t count = 0; // How many numbers there were. Elements that aren't numbers are skipped
+	double sum = 0.0;
+	double min = 0.0; // 0 if there weren't any numbers
+	double max = 0.0;
+
+	double mean() const { return count ? sum / (double)count : 0.0; }
+};
+
 // Struct used to pass parsing options, and receive the error message
 struct ParseContext
 {
@@ -126,14 +523,64 @@ struct ParseContext
 	bool allow_trailing_comma = false;
 	bool allow_cpp_comments = false;
 
+	// Recycle the memory of the Value you are parsing into. Arrays, object
+	// nodes and strings from the previous document are overwritten in place,
+	// and only whatever is left over is freed. This is a big win if you parse
+	// lots of similarly-shaped documents into the same Value. (Object nodes
+	// are only recycled with C++17 or later.)
+	bool reuse_storage = false;
+
+	// Resource limits, for when you are parsing untrusted input. 0 means
+	// no limit. Each limit fails with a different EParseError.
+	size_t max_input_bytes = 0;
+	size_t max_nodes = 0; // Total number of values, including containers
+	size_t max_string_length = 0; // Length (in bytes, after decoding escapes) of any one string or key
+	size_t max_alloc_bytes = 0; // Estimated total memory used by the DOM. This is approximate!
+	int max_depth = 0; // Max nesting of objects and arrays. Set this if you are worried about blowing the stack
+
+	// Give up if the deadline passes, or if another thread sets the cancel
+	// flag. These are checked when we enter objects and arrays. (The clock
+	// is only checked every so often, so the deadline is a little bit fuzzy.)
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	const std::atomic<bool> *cancel = nullptr;
+
+	// Point this at a ParseStats if you want to know what parsing cost.
+	// It is reset at the start of each parse.
+	ParseStats *stats = nullptr;
+
+	// ParseFile: Ask the OS to back the file mapping with huge pages, if
+	// it can. This is just a hint, and only works on some systems.
+	bool file_huge_pages = false;
+
 	// If there's an error, it will be returned here
+	EParseError error = kParseOK;
 	std::string error_message;
 
 	// Line where error occurred. 1-based
-	int error_line = 0;
+	int64_t error_line = 0;
 
 	// Byte offset where the error occurred. 0-based.
-	int error_byte_offset = 0;
+	int64_t error_byte_offset = 0;
+};
+
+// A table of interned keys. It's safe to share one table between any number
+// of threads and documents. Interning the same string always returns a Key
+// pointing to the same string, which lives as long as the table does. This
+// is handy for keys that aren't known until runtime, such as field names
+// from a config file, that you want to look up over and over.
+class KeyTable
+{
+public:
+	Key Intern( const char *key ) { return Intern( key, strlen( key ) ); }
+	Key Intern( const std::string &key ) { return Intern( key.c_str(), key.length() ); }
+	Key Intern( const char *key, size_t len );
+
+	// Number of unique keys in the table
+	size_t size() const;
+
+private:
+	mutable std::mutex _lock;
+	std::unordered_set<std::string> _keys; // Node based, so the strings never move
 };
 
 
@@ -160,14 +607,14 @@ public:
 	//
 
 	// Default constructor sets us to a null value
-	Value() : _type( kNull ) {}
+	Value() : _type( kNull ) { _dummy = {}; }
 
 	// Construct value with the given kind and default value for that kind (0 or empty)
 	explicit Value( EValueType type );
 
 	// Basic C++ object lifetime stuff
 	Value( const Value &x ) { InternalConstruct( x ); }
-	Value( Value &&x ) { InternalConstruct( std::forward<Value>( x ) ); }
+	Value( Value &&x ) VJSON_MOVE_NOEXCEPT { InternalConstruct( std::forward<Value>( x ) ); }
 	~Value() { InternalDestruct(); }
 
 	// Construct directly from primitive values.
@@ -187,7 +634,7 @@ public:
 
 	// Assignment
 	Value &operator=( const Value & x );
-	Value &operator=( Value && x );
+	Value &operator=( Value && x ) VJSON_MOVE_NOEXCEPT;
 	Value &operator=( bool x ) { InternalDestruct(); _type = kBool; _bool = x; return *this; }
 	Value &operator=( double x ) { InternalDestruct(); _type = kDouble; _double = x; return *this; }
 	Value &operator=( int x ) { InternalDestruct(); _type = kDouble; _double = (double)x; return *this; }
@@ -210,6 +657,34 @@ public:
 	template <typename T> void SetArray( size_t n, const T *begin ) { SetArray( begin, begin+n ); }
 	template <typename T> void SetArray( std::initializer_list<T> x ) { SetArray( x.begin(), x.end() ); }; // E.g. SetArray( { "one", "two", "three" } ); Note that they must all be the same type. (If not, wrap all with Value constructors.)
 
+	//
+	// Operations on the whole tree
+	//
+
+	// Free everything, but without recursion. The children are moved onto
+	// a list and freed one container at a time, so this can't blow the stack
+	// no matter how deep the document is. An object or array is left empty
+	// (so an Object& or Array& to it stays valid), and anything else is left
+	// null. See also Reclaimer, to do this on another thread.
+	void Destroy();
+
+	// Add up the memory used by the whole tree. With VJSON_COPY_ON_WRITE, a
+	// container shared by several Values is counted once for each of them.
+	MemoryStats MemoryUsage() const;
+
+	// Shrink every string, array, and (with VJSON_FLAT_OBJECT) object in the
+	// tree to fit, giving back the slack left over from building it. Handy
+	// for documents that will be kept around a long time and not modified.
+	// With VJSON_COPY_ON_WRITE, anything shared is left alone, since
+	// shrinking it would mean copying it.
+	void Compact();
+
+	// Make a deep copy. This is the same as the copy constructor, except
+	// that with VJSON_COPY_ON_WRITE, the result shares nothing with the
+	// original. Containers are reserved up front where possible. Like
+	// Destroy(), this doesn't recurse, so any depth is fine.
+	Value Clone() const;
+
 	//
 	// Read this Value as a specific data type.
 	// There are several different options depending on what checking/conversions
@@ -218,10 +693,13 @@ public:
 
 	// Get this value as the specified type. If the value is not the exact
 	// JSON type, returns a default.  No "conversions" are attempted.
-	const char *  AsCString      ( const char *       defaultVal ) const { return _type == kString ? _string.c_str() : defaultVal; }
-	std::string   AsString       ( const char *       defaultVal ) const { return _type == kString ? _string : std::string( defaultVal ); } // NOTE: always returns a copy
-	std::string   AsString       ( const std::string &defaultVal ) const { return _type == kString ? _string : defaultVal; } // NOTE: always returns a copy, because defaultVal could be a temp!
-	std::string   AsString       ( std::string &&     defaultVal ) const { return _type == kString ? _string : std::forward<std::string>(defaultVal); } // Avoids copy if defaultVal is rvalue
+	const char *  AsCString      ( const char *       defaultVal ) const { return _type == kString ? RawStr().c_str() : defaultVal; }
+	std::string   AsString       ( const char *       defaultVal ) const { return _type == kString ? RawStr() : std::string( defaultVal ); } // NOTE: always returns a copy
+	std::string   AsString       ( const std::string &defaultVal ) const { return _type == kString ? RawStr() : defaultVal; } // NOTE: always returns a copy, because defaultVal could be a temp!
+	std::string   AsString       ( std::string &&     defaultVal ) const { return _type == kString ? RawStr() : std::forward<std::string>(defaultVal); } // Avoids copy if defaultVal is rvalue
+	#if VJSON_HAVE_CPP17
+	std::string_view AsStringView( std::string_view   defaultVal ) const { return _type == kString ? std::string_view( RawStr() ) : defaultVal; } // No copy. Valid until the value changes
+	#endif
 	bool          AsBool         ( bool               defaultVal ) const { return _type == kBool   ? _bool : defaultVal; } // NOTE: requires exact bool type!
 	double        AsDouble       ( double             defaultVal ) const { return _type == kDouble ? _double : defaultVal; }
 	int           AsInt          ( int                defaultVal ) const { return _type == kDouble ? (int)_double : defaultVal; }
@@ -278,9 +756,9 @@ public:
 	// be the exact type; no conversions or type checks are attempted; these will assert
 	// and do other undefined behaviour if called on the wrong type.  You can use these
 	// if you have already done a type check.
-	const char *       GetCString() const { VJSON_ASSERT( _type == kString ); return _string.c_str(); }
-	const std::string &GetString () const { VJSON_ASSERT( _type == kString ); return _string; }
-	std::string &      GetString ()       { VJSON_ASSERT( _type == kString ); return _string; }
+	const char *       GetCString() const { VJSON_ASSERT( _type == kString ); return RawStr().c_str(); }
+	const std::string &GetString () const { VJSON_ASSERT( _type == kString ); return RawStr(); }
+	std::string &      GetString ()       { VJSON_ASSERT( _type == kString ); return RawStr(); }
 	const bool &       GetBool   () const { VJSON_ASSERT( _type == kBool   ); return _bool; }
 	bool &             GetBool   ()       { VJSON_ASSERT( _type == kBool   ); return _bool; }
 	const double &     GetDouble () const { VJSON_ASSERT( _type == kDouble ); return _double; }
@@ -334,7 +812,8 @@ public:
 	//
 	// NOTE: Many lookup functions below accept the key argument as a
 	// template argument K&&.  This was done primarily to keep the code small.
-	// You really can only pass the key as a std::string or const char *.
+	// You really can only pass the key as a std::string, const char *,
+	// Key, or (with C++17) std::string_view.
 	//
 
 	// Set the value at the given key. If the key is not present, it is added.
@@ -346,23 +825,59 @@ public:
 	// Delete the specified key. Returns kOK, kNotObject, or kBadKey
 	template <typename K> EResult EraseAtKey( K&& key );
 
+	// Look up several keys at once. out[i] is set to the value at the i-th
+	// key, or nullptr. Returns the number of keys found. This makes one
+	// pass over the object, rather than one lookup per key.
+	size_t ValuePtrsAtKeys( const KeySet &keys, const Value **out ) const;
+
+	// Look up several keys at once, like a series of *AtKey calls. Each
+	// out argument holds a default, which is replaced if the key is present
+	// and the value has the right type. Supported types are bool, int,
+	// double, std::string, const char *, const Object *, and const Array *.
+	// Returns the number of values replaced.
+	//
+	// int port = 80; std::string host = "localhost"; bool tls = false;
+	// obj.GetAtKeys( kKeys, host, port, tls );
+	template <typename... T> size_t GetAtKeys( const KeySet &keys, T &... out ) const;
+
+	// Same as GetAtKeys, but takes the defaults and returns a tuple.
+	// (Needs C++14.)
+	//
+	// auto [ host, port, tls ] = obj.TupleAtKeys( kKeys, std::string( "localhost" ), 80, false );
+	#if VJSON_HAVE_CPP14
+		template <typename... T> std::tuple<T...> TupleAtKeys( const KeySet &keys, T... defaults ) const;
+	#endif
+
 	// Return true if this is an object, and the key is present
 	bool HasKey( const std::string &key ) const { return ValuePtrAtKey( key ) != nullptr; }
 	bool HasKey( const char        *key ) const { return ValuePtrAtKey( key ) != nullptr; }
+	bool HasKey( const Key         &key ) const { return ValuePtrAtKey( key ) != nullptr; }
+	bool HasKey( const CachedKey   &key ) const { return ValuePtrAtKey( key ) != nullptr; }
+	#if VJSON_HAVE_CPP17
+	bool HasKey( std::string_view   key ) const { return ValuePtrAtKey( key ) != nullptr; }
+	#endif
 
 	// Return number of key/values pairs in object as int or size_t, according to your
 	// predilection for pedantic bullcrap related size_t and the C type system.
 	// Returns 0 if this value is not an object.
-	int    ObjectLen () const { return _type == kObject ? (int)_object.size() : 0; }
-	size_t ObjectSize() const { return _type == kObject ? _object.size() : 0; }
+	int    ObjectLen () const { return _type == kObject ? (int)RawObj().size() : 0; }
+	size_t ObjectSize() const { return _type == kObject ? RawObj().size() : 0; }
 
 	// Lookup by key for generic Values (does not check the type of the child).
 	// Get pointer to Value at the specified key. If called on a Value that
 	// isn't an Object, or if the key is not found, returns nullptr
-	Value       *ValuePtrAtKey( const std::string &key );
-	const Value *ValuePtrAtKey( const std::string &key ) const { return const_cast<Value*>(this)->ValuePtrAtKey( key ); }
-	Value       *ValuePtrAtKey( const char *       key );
-	const Value *ValuePtrAtKey( const char *       key ) const { return const_cast<Value*>(this)->ValuePtrAtKey( key ); }
+	Value       *ValuePtrAtKey( const std::string &key )       { Unshare(); return const_cast<Value*>( ConstThis()->ValuePtrAtKey( key ) ); }
+	const Value *ValuePtrAtKey( const std::string &key ) const;
+	Value       *ValuePtrAtKey( const char *       key )       { Unshare(); return const_cast<Value*>( ConstThis()->ValuePtrAtKey( key ) ); }
+	const Value *ValuePtrAtKey( const char *       key ) const;
+	Value       *ValuePtrAtKey( const Key &        key )       { Unshare(); return const_cast<Value*>( ConstThis()->ValuePtrAtKey( key ) ); }
+	const Value *ValuePtrAtKey( const Key &        key ) const;
+	Value       *ValuePtrAtKey( const CachedKey &  key )       { Unshare(); return const_cast<Value*>( ConstThis()->ValuePtrAtKey( key ) ); }
+	const Value *ValuePtrAtKey( const CachedKey &  key ) const;
+	#if VJSON_HAVE_CPP17
+	Value       *ValuePtrAtKey( std::string_view   key )       { Unshare(); return const_cast<Value*>( ConstThis()->ValuePtrAtKey( key ) ); }
+	const Value *ValuePtrAtKey( std::string_view   key ) const;
+	#endif
 
 	// Return reference to the value at the specified key. If this is not an object,
 	// or the key is not found, returns a reference to a statically-allocated JSON null
@@ -373,22 +888,26 @@ public:
 	// - To add or replace a key, use SetKey() or Object::operator[]
 	// - To get a mutable reference to the value, adding a new value if one does
 	//   not exist, use Object::operator[]
-	// - Access the underlying RawObject (which is just a std::map) directly.
+	// - Access the underlying RawObject (which is just a std::map, unless
+	//   VJSON_FLAT_OBJECT is set) directly.
 	template <typename K> const Value &AtKey( K&& key ) const { const Value *t = ValuePtrAtKey( key ); return t ? *t : GetStaticNullValue(); }
 
 	// Get the value at the specified key as the specified type. If this is not an object,
 	// or the key is not found, or the item is not the correct JSON type, returns a default
-	template <typename K> const char *  CStringAtKey      ( K&& key, const char *       defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->_string.c_str() : defaultVal; }
-	template <typename K> std::string   StringAtKey       ( K&& key, const char *       defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->_string : std::string( defaultVal ); } // NOTE: always returns a copy
-	template <typename K> std::string   StringAtKey       ( K&& key, const std::string &defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->_string : defaultVal; } // NOTE: always returns a copy
-	template <typename K> std::string   StringAtKey       ( K&& key, std::string &&     defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->_string : std::forward<std::string>( defaultVal ); } // Avoids copy
+	template <typename K> const char *  CStringAtKey      ( K&& key, const char *       defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->RawStr().c_str() : defaultVal; }
+	template <typename K> std::string   StringAtKey       ( K&& key, const char *       defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->RawStr() : std::string( defaultVal ); } // NOTE: always returns a copy
+	template <typename K> std::string   StringAtKey       ( K&& key, const std::string &defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->RawStr() : defaultVal; } // NOTE: always returns a copy
+	template <typename K> std::string   StringAtKey       ( K&& key, std::string &&     defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? t->RawStr() : std::forward<std::string>( defaultVal ); } // Avoids copy
+	#if VJSON_HAVE_CPP17
+	template <typename K> std::string_view StringViewAtKey( K&& key, std::string_view   defaultVal ) const { const Value *t = InternalAtKey( key, kString ); return t ? std::string_view( t->RawStr() ) : defaultVal; } // No copy. Valid until the value changes
+	#endif
 	template <typename K> bool          BoolAtKey         ( K&& key, bool               defaultVal ) const { const Value *t = InternalAtKey( key, kBool   ); return t ? t->_bool : defaultVal; } // Requires strict bool type!
 	template <typename K> double        DoubleAtKey       ( K&& key, double             defaultVal ) const { const Value *t = InternalAtKey( key, kDouble ); return t ? t->_double : defaultVal; }
 	template <typename K> int           IntAtKey          ( K&& key, int                defaultVal ) const { const Value *t = InternalAtKey( key, kDouble ); return t ? (int)t->_double : defaultVal; }
 	template <typename K> const Object *ObjectPtrAtKey    ( K&& key                                ) const { return (const Object *)InternalAtKey( key, kObject ); }
-	template <typename K> Object *      ObjectPtrAtKey    ( K&& key                                )       { return (      Object *)InternalAtKey( key, kObject ); }
+	template <typename K> Object *      ObjectPtrAtKey    ( K&& key                                )       { Unshare(); return (      Object *)InternalAtKey( key, kObject ); }
 	template <typename K> const Array * ArrayPtrAtKey     ( K&& key                                ) const { return (const Array  *)InternalAtKey( key, kArray  ); }
-	template <typename K> Array *       ArrayPtrAtKey     ( K&& key                                )       { return (      Array  *)InternalAtKey( key, kArray  ); }
+	template <typename K> Array *       ArrayPtrAtKey     ( K&& key                                )       { Unshare(); return (      Array  *)InternalAtKey( key, kArray  ); }
 	template <typename K> const Array  &ArrayAtKeyOrEmpty ( K&& key                                ) const { const Array  *t = (const Array  *)InternalAtKey( key, kArray  ); return t ? *t : GetStaticEmptyArray(); }
 	template <typename K> const Object &ObjectAtKeyOrEmpty( K&& key                                ) const { const Object *t = (const Object *)InternalAtKey( key, kObject ); return t ? *t : GetStaticEmptyObject(); }
 
@@ -420,8 +939,8 @@ public:
 	// Get the length of the array as an int or size_t, according to your
 	// predilection for pedantic bullcrap related to size_t and the C type system.
 	// Returns 0 if this value is not an array.
-	int    ArrayLen () const { return _type == kArray ? (int)_array.size() : 0; }
-	size_t ArraySize() const { return _type == kArray ? _array.size() : 0; }
+	int    ArrayLen () const { return _type == kArray ? (int)RawArr().size() : 0; }
+	size_t ArraySize() const { return _type == kArray ? RawArr().size() : 0; }
 
 	// Return reference to the value at the specified index. If this is not an array,
 	// or the index is out of bounds, returns a reference to a statically-allocated null
@@ -429,26 +948,29 @@ public:
 	//
 	// Note that there is no non-const version of this function! To modify an at
 	// a given index, either use ValuePtrAtIndex() or Array::operator[]
-	const Value &AtIndex( size_t idx ) const { return ( _type == kArray && idx < _array.size() ) ? _array[idx] : GetStaticNullValue(); }
+	const Value &AtIndex( size_t idx ) const { return ( _type == kArray && idx < RawArr().size() ) ? RawArr()[idx] : GetStaticNullValue(); }
 
 	// Get pointer to Value at the specified index. If you call this on a Value
 	// that isn't an Array, or the index is invalid, returns nullptr
-	const Value *ValuePtrAtIndex( size_t idx ) const { return ( _type == kArray && idx < _array.size() ) ? &_array[idx] : nullptr; }
-	Value *      ValuePtrAtIndex( size_t idx )       { return ( _type == kArray && idx < _array.size() ) ? &_array[idx] : nullptr; }
+	const Value *ValuePtrAtIndex( size_t idx ) const { return ( _type == kArray && idx < RawArr().size() ) ? &RawArr()[idx] : nullptr; }
+	Value *      ValuePtrAtIndex( size_t idx )       { return ( _type == kArray && idx < RawArr().size() ) ? &RawArr()[idx] : nullptr; }
 
 	// Get the value at the specified index as the specified type. If this is not an array,
 	// or the index is invalid, or the item is the wrong type, returns an appropriate default
-	const char *  CStringAtIndex      ( size_t idx, const char *       defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->_string.c_str() : defaultVal; }
-	std::string   StringAtIndex       ( size_t idx, const char *       defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->_string : std::string( defaultVal ); } // NOTE: always returns a copy
-	std::string   StringAtIndex       ( size_t idx, const std::string &defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->_string : defaultVal; } // NOTE: always returns a copy
-	std::string   StringAtIndex       ( size_t idx, std::string &&     defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->_string : std::forward<std::string>( defaultVal ); } // Avoids the copy
+	const char *  CStringAtIndex      ( size_t idx, const char *       defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->RawStr().c_str() : defaultVal; }
+	std::string   StringAtIndex       ( size_t idx, const char *       defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->RawStr() : std::string( defaultVal ); } // NOTE: always returns a copy
+	std::string   StringAtIndex       ( size_t idx, const std::string &defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->RawStr() : defaultVal; } // NOTE: always returns a copy
+	std::string   StringAtIndex       ( size_t idx, std::string &&     defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? t->RawStr() : std::forward<std::string>( defaultVal ); } // Avoids the copy
+	#if VJSON_HAVE_CPP17
+	std::string_view StringViewAtIndex( size_t idx, std::string_view   defaultVal ) const { const Value *t = InternalAtIndex( idx, kString ); return t ? std::string_view( t->RawStr() ) : defaultVal; } // No copy
+	#endif
 	bool          BoolAtIndex         ( size_t idx, bool               defaultVal ) const { const Value *t = InternalAtIndex( idx, kBool   ); return t ? t->_bool : defaultVal; } // Requires strict bool type
 	double        DoubleAtIndex       ( size_t idx, double             defaultVal ) const { const Value *t = InternalAtIndex( idx, kDouble ); return t ? t->_bool : defaultVal; }
 	int           IntAtIndex          ( size_t idx, int                defaultVal ) const { const Value *t = InternalAtIndex( idx, kDouble ); return t ? (int)t->_double : defaultVal; }
 	const Object *ObjectPtrAtIndex    ( size_t idx                                ) const { return (const Object *)InternalAtIndex( idx, kObject ); }
-	Object *      ObjectPtrAtIndex    ( size_t idx                                )       { return (      Object *)InternalAtIndex( idx, kObject ); }
+	Object *      ObjectPtrAtIndex    ( size_t idx                                )       { Unshare(); return (      Object *)InternalAtIndex( idx, kObject ); }
 	const Array * ArrayPtrAtIndex     ( size_t idx                                ) const { return (const Array  *)InternalAtIndex( idx, kArray  ); }
-	Array *       ArrayPtrAtIndex     ( size_t idx                                )       { return (      Array  *)InternalAtIndex( idx, kArray  ); }
+	Array *       ArrayPtrAtIndex     ( size_t idx                                )       { Unshare(); return (      Array  *)InternalAtIndex( idx, kArray  ); }
 	const Array  &ArrayAtIndexOrEmpty ( size_t idx                                ) const { const Array  *t = (const Array  *)InternalAtIndex( idx, kArray  ); return t ? *t : GetStaticEmptyArray(); }
 	const Object &ObjectAtIndexOrEmpty( size_t idx                                ) const { const Object *t = (const Object *)InternalAtIndex( idx, kObject ); return t ? *t : GetStaticEmptyObject(); }
 
@@ -465,6 +987,35 @@ public:
 	int         InterpretAsIntAtIndex   ( size_t idx, int                defaultVal ) const { TryInterpretAtIndex( idx, defaultVal ); return defaultVal; }
 	uint64      InterpretAsUint64AtIndex( size_t idx, uint64_t           defaultVal ) const { TryInterpretAtIndex( idx, defaultVal ); return defaultVal; }
 
+	//
+	// Path access
+	//
+	// Look up a value nested any number of levels deep, using a JSON Pointer
+	// compiled into a Path. These work just like the *AtKey functions: if
+	// any step along the way is missing or the wrong type, you get the
+	// default.
+	//
+	// static const vjson::Path kBurst( "/config/limits/rate/burst" );
+	// int burst = doc.IntAtPath( kBurst, 10 );
+	//
+
+	const Value &AtPath( const Path &path ) const { const Value *t = ValuePtrAtPath( path ); return t ? *t : GetStaticNullValue(); }
+	Value       *ValuePtrAtPath( const Path &path );
+	const Value *ValuePtrAtPath( const Path &path ) const;
+
+	const char *  CStringAtPath      ( const Path &path, const char *       defaultVal ) const { const Value *t = InternalAtPath( path, kString ); return t ? t->RawStr().c_str() : defaultVal; }
+	std::string   StringAtPath       ( const Path &path, const char *       defaultVal ) const { const Value *t = InternalAtPath( path, kString ); return t ? t->RawStr() : std::string( defaultVal ); } // NOTE: always returns a copy
+	std::string   StringAtPath       ( const Path &path, const std::string &defaultVal ) const { const Value *t = InternalAtPath( path, kString ); return t ? t->RawStr() : defaultVal; } // NOTE: always returns a copy
+	bool          BoolAtPath         ( const Path &path, bool               defaultVal ) const { const Value *t = InternalAtPath( path, kBool   ); return t ? t->_bool : defaultVal; } // Requires strict bool type
+	double        DoubleAtPath       ( const Path &path, double             defaultVal ) const { const Value *t = InternalAtPath( path, kDouble ); return t ? t->_double : defaultVal; }
+	int           IntAtPath          ( const Path &path, int                defaultVal ) const { const Value *t = InternalAtPath( path, kDouble ); return t ? (int)t->_double : defaultVal; }
+	const Array  &ArrayAtPathOrEmpty ( const Path &path                                ) const { const Array  *t = (const Array  *)InternalAtPath( path, kArray  ); return t ? *t : GetStaticEmptyArray(); }
+	const Object &ObjectAtPathOrEmpty( const Path &path                                ) const { const Object *t = (const Object *)InternalAtPath( path, kObject ); return t ? *t : GetStaticEmptyObject(); }
+
+	// Like TryInterpretAtKey. On failure, returns the error from the step
+	// where the lookup failed.
+	template <typename T> EResult TryInterpretAtPath( const Path &path, T &outResult ) const;
+
 	//
 	// Parsing/print JSON text
 	//
@@ -477,6 +1028,10 @@ public:
 	inline bool ParseJSON( const std::string &s, ParseContext *ctx = nullptr ) { return ParseJSON( s.c_str(), s.c_str() + s.length(), ctx ); }
 	bool ParseJSON( const char *begin, const char *end, ParseContext *ctx = nullptr );
 
+	// Parse a file. The file is memory-mapped and parsed in place, rather than
+	// being read into memory first, so this is the way to load huge files.
+	bool ParseFile( const char *filename, ParseContext *ctx = nullptr );
+
 	// Print the value to JSON text.
 	std::string PrintJSON( const PrintOptions &opt = PrintOptions{} ) const;
 
@@ -486,26 +1041,150 @@ public:
 	#endif
 
 protected:
+	friend class ArrayIndex;
 
 	EValueType _type;
-	union
-	{
-		double _double;
-		bool _bool;
-		RawObject _object;
-		RawArray _array;
-		std::string _string;
-		struct { char x[8]; } _dummy;
-	};
 
+	// Changes whenever an array's storage is handed out for modification,
+	// except for appending. (See ArrayIndex.) This fits in what would
+	// otherwise be padding, so it doesn't make a Value any bigger.
+	uint32_t _epoch = 0;
+	#if VJSON_COPY_ON_WRITE
+		// Strings and aggregates are on the heap, and maybe shared
+		union
+		{
+			double _double;
+			bool _bool;
+			SharedBox<RawObject> *_object;
+			SharedBox<RawArray> *_array;
+			SharedBox<std::string> *_string;
+			struct { char x[8]; } _dummy;
+		};
+		RawObject         &RawObj()       { return UnshareBox( _object ); }
+		const RawObject   &RawObj() const { return _object->value; }
+		RawArray          &RawArr()       { ++_epoch; return UnshareBox( _array ); }
+		RawArray          &AppendArr()    { return UnshareBox( _array ); } // Only to add to the end
+		const RawArray    &RawArr() const { return _array->value; }
+		std::string       &RawStr()       { return UnshareBox( _string ); }
+		const std::string &RawStr() const { return _string->value; }
+
+		// Make sure we have our own copy of our storage, before handing out
+		// a mutable pointer to a child.
+		void Unshare()
+		{
+			if ( _type == kObject )
+				UnshareBox( _object );
+			else if ( _type == kArray )
+				UnshareBox( _array );
+		}
+	#elif VJSON_COMPACT_VALUE
+		// Strings and aggregates are on the heap
+		union
+		{
+			double _double;
+			bool _bool;
+			RawObject *_object;
+			RawArray *_array;
+			std::string *_string;
+			struct { char x[8]; } _dummy;
+		};
+		RawObject         &RawObj()       { return *_object; }
+		const RawObject   &RawObj() const { return *_object; }
+		RawArray          &RawArr()       { ++_epoch; return *_array; }
+		RawArray          &AppendArr()    { return *_array; } // Only to add to the end
+		const RawArray    &RawArr() const { return *_array; }
+		std::string       &RawStr()       { return *_string; }
+		const std::string &RawStr() const { return *_string; }
+	#else
+		union
+		{
+			double _double;
+			bool _bool;
+			RawObject _object;
+			RawArray _array;
+			std::string _string;
+			struct { char x[8]; } _dummy;
+		};
+		RawObject         &RawObj()       { return _object; }
+		const RawObject   &RawObj() const { return _object; }
+		RawArray          &RawArr()       { ++_epoch; return _array; }
+		RawArray          &AppendArr()    { return _array; } // Only to add to the end
+		const RawArray    &RawArr() const { return _array; }
+		std::string       &RawStr()       { return _string; }
+		const std::string &RawStr() const { return _string; }
+	#endif
+	#if !VJSON_COPY_ON_WRITE
+		void Unshare() {}
+	#endif
+
+	const Value *ConstThis() const { return this; }
+	bool InternalContains( const Value &x ) const; // Is x one of our descendants?
 	void InternalDestruct();
 	void InternalConstruct( const Value &x );
-	void InternalConstruct( Value &&x );
+	void InternalConstruct( Value &&x ) VJSON_MOVE_NOEXCEPT;
+
+	// A moved-from Object or Array is an empty one, just like a moved-from
+	// STL container. With VJSON_COMPACT_VALUE, the move took our box and
+	// left us null, so we need a new one.
+	void InternalMovedFrom( EValueType t )
+	{
+		if ( _type == t )
+			return;
+		VJSON_ASSERT( _type == kNull );
+		if ( t == kObject )
+			SetEmptyObject();
+		else
+			SetEmptyArray();
+	}
 	Value *InternalAtIndex( size_t idx, EValueType t ) const;
+	Value *InternalAtPath( const Path &path, EValueType t ) const;
+	static bool AssignIfType( const Value *v, bool          &out ) { if ( !v || v->_type != kBool   ) return false; out = v->_bool; return true; }
+	static bool AssignIfType( const Value *v, int           &out ) { if ( !v || v->_type != kDouble ) return false; out = (int)v->_double; return true; }
+	static bool AssignIfType( const Value *v, double        &out ) { if ( !v || v->_type != kDouble ) return false; out = v->_double; return true; }
+	static bool AssignIfType( const Value *v, std::string   &out ) { if ( !v || v->_type != kString ) return false; out = v->RawStr(); return true; }
+	static bool AssignIfType( const Value *v, const char   *&out ) { if ( !v || v->_type != kString ) return false; out = v->RawStr().c_str(); return true; }
+	static bool AssignIfType( const Value *v, const Object *&out ) { if ( !v || v->_type != kObject ) return false; out = (const Object *)v; return true; }
+	static bool AssignIfType( const Value *v, const Array  *&out ) { if ( !v || v->_type != kArray  ) return false; out = (const Array  *)v; return true; }
+	#if VJSON_HAVE_CPP14
+		template <typename Tuple, size_t... I> size_t InternalTupleAtKeys( const KeySet &keys, Tuple &t, std::index_sequence<I...> ) const { return GetAtKeys( keys, std::get<I>( t )... ); }
+	#endif
 	Value *InternalAtKey( const std::string &key, EValueType t ) const;
 	Value *InternalAtKey( const char *key, EValueType t ) const;
+	Value *InternalAtKey( const Key &key, EValueType t ) const;
+	Value *InternalAtKey( const CachedKey &key, EValueType t ) const;
+	#if VJSON_HAVE_CPP17
+	Value *InternalAtKey( std::string_view key, EValueType t ) const;
+	#endif
 };
 
+// A member that has been taken out of an object with Object::Extract(),
+// owning the key and the value. With C++17 and std::map storage, this is
+// the map's own node handle, so the member moves from one object to
+// another without allocating or copying anything. Otherwise, it holds the
+// key and value, which are moved in and out.
+#if VJSON_HAVE_CPP17 && !VJSON_FLAT_OBJECT
+	using ObjectNode = RawObject::node_type;
+#else
+	class ObjectNode
+	{
+	public:
+		ObjectNode() {}
+		ObjectNode( std::string &&key, Value &&value ) : _item( std::move( key ), std::move( value ) ), _empty( false ) {}
+		ObjectNode( ObjectNode &&x ) VJSON_MOVE_NOEXCEPT : _item( std::move( x._item ) ), _empty( x._empty ) { x._empty = true; }
+		ObjectNode &operator=( ObjectNode &&x ) VJSON_MOVE_NOEXCEPT { _item = std::move( x._item ); _empty = x._empty; x._empty = true; return *this; }
+
+		// Same interface as std::map::node_type
+		bool empty() const { return _empty; }
+		explicit operator bool() const { return !_empty; }
+		std::string &key() const { VJSON_ASSERT( !_empty ); return _item.first; }
+		Value &mapped() const { VJSON_ASSERT( !_empty ); return _item.second; }
+
+	private:
+		mutable std::pair<std::string, Value> _item;
+		bool _empty = true;
+	};
+#endif
+
 // An Object is a Value that is known (or at least assumed) to be of type
 // kObject. Since it is assumed to be an object, we can provide a more
 // idiomatic object interface, and we can optimize a few function calls.
@@ -523,9 +1202,9 @@ class Object : public Value
 public:
 	Object() : Value( kObject ) {}
 	Object( const Object &x ) : Value( x ) {}
-	Object( Object &&x ) : Value( std::forward<Object>(x) ) {}
+	Object( Object &&x ) noexcept( !VJSON_COMPACT_VALUE && std::is_nothrow_move_constructible<RawObject>::value ) : Value( std::forward<Object>(x) ) { x.InternalMovedFrom( kObject ); }
 	Object &operator=( const Object & x ) { VJSON_ASSERT( x._type == kObject ); Value::operator=(x); return *this; }
-	Object &operator=( Object && x ) { VJSON_ASSERT( x._type == kObject ); Value::operator=(std::forward<Object>(x)); return *this; }
+	Object &operator=( Object && x ) { VJSON_ASSERT( x._type == kObject ); Value::operator=(std::forward<Object>(x)); x.InternalMovedFrom( kObject ); return *this; }
 	Object &operator=( const RawObject & x ) { Value::operator=(x); return *this; }
 	Object &operator=( RawObject && x ) { Value::operator=(std::forward<RawObject>(x)); return *this; }
 
@@ -533,28 +1212,44 @@ public:
 	inline bool ParseJSON( const char *c_str, ParseContext *ctx = nullptr ) { return ParseJSON( c_str, c_str + strlen(c_str), ctx ); }
 	inline bool ParseJSON( const std::string &s, ParseContext *ctx = nullptr ) { return ParseJSON( s.c_str(), s.c_str() + s.length(), ctx ); }
 	bool ParseJSON( const char *begin, const char *end, ParseContext *ctx = nullptr );
+	bool ParseFile( const char *filename, ParseContext *ctx = nullptr );
 
 	// Override ObjectLen(), we know we are an Object
-	int    ObjectLen()  const { VJSON_ASSERT( _type == kObject ); return (int)_object.size(); }
-	size_t ObjectSize() const { VJSON_ASSERT( _type == kObject ); return _object.size(); }
-	int    Len()        const { VJSON_ASSERT( _type == kObject ); return (int)_object.size(); }
-	size_t size()       const { VJSON_ASSERT( _type == kObject ); return _object.size(); }
+	int    ObjectLen()  const { VJSON_ASSERT( _type == kObject ); return (int)RawObj().size(); }
+	size_t ObjectSize() const { VJSON_ASSERT( _type == kObject ); return RawObj().size(); }
+	int    Len()        const { VJSON_ASSERT( _type == kObject ); return (int)RawObj().size(); }
+	size_t size()       const { VJSON_ASSERT( _type == kObject ); return RawObj().size(); }
 
 	// Standard array access notation Operator[]. This works just like the std::map
 	// version. It inserts the default argument if not found, and cannot be invoked
 	// on a const Object. (Use Value::AtKey() for read-only access that won't
 	// add a new key if the key is not already present. )
-	template <typename K> Value &operator[]( K &&key ) { VJSON_ASSERT( _type == kObject ); return _object[ std::forward<K>( key ) ]; }
+	template <typename K> Value &operator[]( K &&key ) { VJSON_ASSERT( _type == kObject ); return RawObj()[ KeyToInsert( std::forward<K>( key ) ) ]; }
 
 	// Return true if the object is empty
-	bool empty() const { VJSON_ASSERT( _type == kObject ); return _object.empty(); }
+	bool empty() const { VJSON_ASSERT( _type == kObject ); return RawObj().empty(); }
 
 	// Remove all the items from the object
-	void clear() { VJSON_ASSERT( _type == kObject ); _object.clear(); }
+	void clear() { VJSON_ASSERT( _type == kObject ); RawObj().clear(); }
+
+	// Remove a member and return it, key and value together, so that it can
+	// be put into another object with Insert(). The value is moved, not
+	// copied, so this is a cheap way to hand a whole subtree from one
+	// document to another. Returns an empty node if the key isn't present.
+	template <typename K> ObjectNode Extract( K &&key );
+
+	// Add a member that was taken out of an object with Extract(). If the
+	// key is already present, the value is replaced, like SetAtKey. Returns
+	// the value, or nullptr if the node is empty. The node is left empty.
+	Value *Insert( ObjectNode &&node );
+
+	// Move all the items into a FrozenObject, which can't be modified but
+	// has faster lookup. We are left empty. See FrozenObject::Thaw()
+	FrozenObject Freeze();
 
 	// Access the underlying storage
-	inline RawObject       &Raw()       { VJSON_ASSERT( _type == kObject ); return _object; }
-	inline RawObject const &Raw() const { VJSON_ASSERT( _type == kObject ); return _object; }
+	inline RawObject       &Raw()       { VJSON_ASSERT( _type == kObject ); return RawObj(); }
+	inline RawObject const &Raw() const { VJSON_ASSERT( _type == kObject ); return RawObj(); }
 
 	// Range-based for. Example:
 	//
@@ -566,10 +1261,10 @@ public:
 	// }
 
 	// Iterate all values.
-	RawObject::iterator       begin()       { VJSON_ASSERT( _type == kObject ); return _object.begin(); }
-	RawObject::iterator       end()         { VJSON_ASSERT( _type == kObject ); return _object.end(); }
-	RawObject::const_iterator begin() const { VJSON_ASSERT( _type == kObject ); return _object.begin(); }
-	RawObject::const_iterator end()   const { VJSON_ASSERT( _type == kObject ); return _object.end(); }
+	RawObject::iterator       begin()       { VJSON_ASSERT( _type == kObject ); return RawObj().begin(); }
+	RawObject::iterator       end()         { VJSON_ASSERT( _type == kObject ); return RawObj().end(); }
+	RawObject::const_iterator begin() const { VJSON_ASSERT( _type == kObject ); return RawObj().begin(); }
+	RawObject::const_iterator end()   const { VJSON_ASSERT( _type == kObject ); return RawObj().end(); }
 
 	// TODO - add type-specific iterators, so you can easily iterate, e.g. all the ints
 };
@@ -581,11 +1276,11 @@ class Array : public Value
 public:
 	Array() : Value( kArray ) {}
 	Array( const Array &x ) : Value( x ) {}
-	Array( Array &&x ) : Value( std::forward<Array>(x) ) {}
+	Array( Array &&x ) noexcept( !VJSON_COMPACT_VALUE ) : Value( std::forward<Array>(x) ) { x.InternalMovedFrom( kArray ); }
 	Array( const RawArray &x ) : Value( x ) {}
 	Array( RawArray && x ) : Value( std::forward<RawArray>( x ) ) {}
 	Array &operator=( const Array & x ) { VJSON_ASSERT( x._type == kArray ); Value::operator=(x); return *this; }
-	Array &operator=( Array && x ) { VJSON_ASSERT( x._type == kArray ); Value::operator=(std::forward<Array>(x)); return *this; }
+	Array &operator=( Array && x ) { VJSON_ASSERT( x._type == kArray ); Value::operator=(std::forward<Array>(x)); x.InternalMovedFrom( kArray ); return *this; }
 	Array &operator=( const RawArray & x ) { Value::operator=(x); return *this; }
 	Array &operator=( RawArray && x ) { Value::operator=(std::forward<Array>(x)); return *this; }
 
@@ -594,40 +1289,46 @@ public:
 	//Value( std::initializer_list<Value> x ); FIXME
 
 	// Override ArrayLen(), we know we are an array. Also provide shorter versions
-	int    ArrayLen()  const { VJSON_ASSERT( _type == kArray ); return (int)_array.size(); }
-	size_t ArraySize() const { VJSON_ASSERT( _type == kArray ); return _array.size(); }
-	int    Len()       const { VJSON_ASSERT( _type == kArray ); return (int)_array.size(); }
-	size_t size()      const { VJSON_ASSERT( _type == kArray ); return _array.size(); } // not capitalized because we want to be as similar to std::vector as possible
+	int    ArrayLen()  const { VJSON_ASSERT( _type == kArray ); return (int)RawArr().size(); }
+	size_t ArraySize() const { VJSON_ASSERT( _type == kArray ); return RawArr().size(); }
+	int    Len()       const { VJSON_ASSERT( _type == kArray ); return (int)RawArr().size(); }
+	size_t size()      const { VJSON_ASSERT( _type == kArray ); return RawArr().size(); } // not capitalized because we want to be as similar to std::vector as possible
 
 	// Standard array access notation Operator[]
-	Value       &operator[]( size_t idx )       { VJSON_ASSERT( _type == kArray ); return _array[idx]; }
-	const Value &operator[]( size_t idx ) const { VJSON_ASSERT( _type == kArray ); return _array[idx]; }
+	Value       &operator[]( size_t idx )       { VJSON_ASSERT( _type == kArray ); return RawArr()[idx]; }
+	const Value &operator[]( size_t idx ) const { VJSON_ASSERT( _type == kArray ); return RawArr()[idx]; }
 
 	// Return true if the array is empty
-	bool empty() const { VJSON_ASSERT( _type == kArray ); return _array.empty(); }
+	bool empty() const { VJSON_ASSERT( _type == kArray ); return RawArr().empty(); }
 
 	// Remove all the items from the array
-	void clear() { VJSON_ASSERT( _type == kArray ); _array.clear(); }
+	void clear() { VJSON_ASSERT( _type == kArray ); RawArr().clear(); }
 
 	// Add a null value to the end of the the array, and return a reference
-	Value &push_back() { VJSON_ASSERT( _type == kArray ); _array.push_back( Value{} ); return _array[ _array.size()-1 ]; }
+	Value &push_back() { VJSON_ASSERT( _type == kArray ); RawArray &a = AppendArr(); a.push_back( Value{} ); return a.back(); }
 
 	// Push something to the end of the array, and return a reference to the newly created
 	// thing. Any argument from which you can construct a Value will work.
-	template< typename Arg > Value &push_back( Arg &&a ) { VJSON_ASSERT( _type == kArray ); _array.push_back( std::forward<Arg>( a ) ); return _array[ _array.size()-1 ]; }
+	template< typename Arg > Value &push_back( Arg &&x ) { VJSON_ASSERT( _type == kArray ); RawArray &a = AppendArr(); a.push_back( std::forward<Arg>( x ) ); return a.back(); }
+
+	// Move the elements in [first,last) to the end of dst, and remove them
+	// from this array. Elements are moved, not copied, so whole subtrees
+	// change hands without copying. (dst may need to grow, unless you have
+	// reserved it.) Returns the number of elements moved.
+	size_t Splice( size_t first, size_t last, Array &dst );
 
 	// Get direct access to the underlying vector
-	const RawArray &Raw() const { VJSON_ASSERT( _type == kArray ); return _array; }
-	RawArray       &Raw()       { VJSON_ASSERT( _type == kArray ); return _array; }
+	const RawArray &Raw() const { VJSON_ASSERT( _type == kArray ); return RawArr(); }
+	RawArray       &Raw()       { VJSON_ASSERT( _type == kArray ); return RawArr(); }
 
 	// Iterate all the values int he array (range-based for).  Example:
 	//
 	// Array arr;
 	// for ( Value &val: arr ) {}
-	Value *      begin()       { VJSON_ASSERT( _type == kArray ); return _array.data(); }
-	Value *      end()         { VJSON_ASSERT( _type == kArray ); return _array.data() + _array.size(); }
-	const Value *begin() const { VJSON_ASSERT( _type == kArray ); return _array.data(); }
-	const Value *end()   const { VJSON_ASSERT( _type == kArray ); return _array.data() + _array.size(); }
+	Value *      begin()       { VJSON_ASSERT( _type == kArray ); return RawArr().data(); }
+	Value *      end()         { VJSON_ASSERT( _type == kArray ); return RawArr().data() + RawArr().size(); }
+	const Value *begin() const { VJSON_ASSERT( _type == kArray ); return RawArr().data(); }
+	const Value *end()   const { VJSON_ASSERT( _type == kArray ); return RawArr().data() + RawArr().size(); }
 
 	// Iterate only the elements of the arrayu that are of the specified
 	// type. (Elements Values of other types.)  Any T for which you can
@@ -640,6 +1341,747 @@ public:
 	// for ( Object &x: arr.Iter<Object>() ) {}
 	template <typename T> ConstArrayRange<T> Iter() const;
 	template <typename T> MutableArrayRange<T> Iter();
+
+	// If every element is a number, return a view of them, so your numeric
+	// code can read them without making a copy. Otherwise, returns an empty
+	// view. (Check the type of each element with Iter<double>() if you want
+	// to skip the ones that aren't numbers.) The view is invalidated if the
+	// array is modified.
+	StridedSpan<double> Numbers() const;
+
+	// Same thing, for an array of bools
+	StridedSpan<bool> Bools() const;
+
+	// Aggregate the numbers in the array in one pass. Elements that are not
+	// numbers are skipped, just like Iter<double>(). This is quite a bit
+	// faster than looping over Iter<double>() yourself. Note that the sum
+	// is added up in a different order than a simple loop would, so the
+	// last few bits might not match.
+	NumberStats Summarize() const;
+
+	// Count the numbers in [lo,hi) into equal-width buckets. Numbers outside
+	// the range, and elements that aren't numbers, are not counted.
+	std::vector<size_t> Histogram( double lo, double hi, size_t buckets ) const;
+
+	// Same thing, but for an array of objects: aggregate the numeric field
+	// with the given key. Elements that aren't objects, or don't have the
+	// key, or where it isn't a number, are skipped. Example:
+	//
+	// double total = orders.SummarizeAtKey( "price"_vk ).sum;
+	NumberStats SummarizeAtKey( const Key &key ) const;
+	NumberStats SummarizeAtKey( const char *key ) const { return SummarizeAtKey( Key( key ) ); }
+	std::vector<size_t> HistogramAtKey( const Key &key, double lo, double hi, size_t buckets ) const;
+	std::vector<size_t> HistogramAtKey( const char *key, double lo, double hi, size_t buckets ) const { return HistogramAtKey( Key( key ), lo, hi, buckets ); }
+};
+
+// A read-only view of numbers (or bools) that live inside the elements of
+// an Array. See Array::Numbers(). They are not packed together: each one
+// is stride bytes after the previous one.
+template <typename T>
+class StridedSpan
+{
+public:
+	static constexpr size_t stride = sizeof(Value);
+
+	StridedSpan() {}
+	StridedSpan( const T *first, size_t count ) : _first( first ), _count( count ) {}
+
+	size_t size() const { return _count; }
+	bool empty() const { return _count == 0; }
+	const T &operator[]( size_t idx ) const { VJSON_ASSERT( idx < _count ); return *(const T *)( (const char *)_first + idx*stride ); }
+
+	struct const_iterator
+	{
+		const char *p;
+		const T &operator*() const { return *(const T *)p; }
+		const_iterator &operator++() { p += stride; return *this; }
+		bool operator==( const const_iterator &x ) const { return p == x.p; }
+		bool operator!=( const const_iterator &x ) const { return p != x.p; }
+	};
+	const_iterator begin() const { return const_iterator{ (const char *)_first }; }
+	const_iterator end()   const { return const_iterator{ (const char *)_first + _count*stride }; }
+
+private:
+	const T *_first = nullptr;
+	size_t _count = 0;
+};
+
+// Builds an object in place. Values are constructed right where they
+// live, from any arguments that a Value can be constructed from, rather
+// than being made as temporaries and then copied or moved in. Example:
+//
+// vjson::Object resp;
+// vjson::ObjectBuilder b( resp );
+// b.Emplace( "id", 42 );
+// b.Emplace( "name", std::move( name ) ); // Moved, not copied
+// vjson::ArrayBuilder tags = b.EmplaceArray( "tags" );
+// tags.Reserve( n );
+//
+// A child builder points into its parent, so finish with the child before
+// adding anything else to the parent. (Adding to a parent may move its
+// members, unless it has been reserved.)
+class ObjectBuilder
+{
+public:
+	// Build onto whatever is in the object already
+	explicit ObjectBuilder( Object &obj ) : _obj( &obj ) {}
+
+	// If the value isn't an object, it is set to an empty one
+	explicit ObjectBuilder( Value &val ) : _obj( val.IsObject() ? (Object *)&val : nullptr ) { if ( !_obj ) { val.SetEmptyObject(); _obj = (Object *)&val; } }
+
+	// Make room for n more members. (Only does anything with
+	// VJSON_FLAT_OBJECT. A std::map can't reserve.)
+	void Reserve( size_t n );
+
+	// Add a member, or replace it if the key is already present, and return
+	// the value. Pass an rvalue std::string as the key to move it in.
+	template <typename K, typename... A> Value &Emplace( K &&key, A&&... args );
+
+	// Same as Emplace, but skips the search. The keys you add this way must
+	// be new, and (unless VJSON_FLAT_OBJECT is set) each one must sort after
+	// all the keys already in the object. This is checked by VJSON_ASSERT.
+	template <typename K, typename... A> Value &EmplaceSorted( K &&key, A&&... args );
+
+	// Add an empty object or array, and return a builder for it
+	template <typename K> ObjectBuilder EmplaceObject( K &&key ) { return ObjectBuilder( Emplace( std::forward<K>( key ), kObject ) ); }
+	template <typename K> ArrayBuilder  EmplaceArray ( K &&key );
+
+	Object &Get() const { return *_obj; }
+
+private:
+	Object *_obj;
+};
+
+// Builds an array in place. See ObjectBuilder.
+class ArrayBuilder
+{
+public:
+	// Build onto whatever is in the array already
+	explicit ArrayBuilder( Array &arr ) : _arr( &arr ) {}
+
+	// If the value isn't an array, it is set to an empty one
+	explicit ArrayBuilder( Value &val ) : _arr( val.IsArray() ? (Array *)&val : nullptr ) { if ( !_arr ) { val.SetEmptyArray(); _arr = (Array *)&val; } }
+
+	// Make room for n more elements
+	void Reserve( size_t n ) { RawArray &raw = _arr->Raw(); raw.reserve( raw.size() + n ); }
+
+	// Add an element, constructed from args, and return it
+	template <typename... A> Value &Emplace( A&&... args ) { RawArray &raw = _arr->Raw(); raw.emplace_back( std::forward<A>( args )... ); return raw.back(); }
+
+	// Add an empty object or array, and return a builder for it
+	ObjectBuilder EmplaceObject() { return ObjectBuilder( Emplace( kObject ) ); }
+	ArrayBuilder  EmplaceArray () { return ArrayBuilder( Emplace( kArray ) ); }
+
+	Array &Get() const { return *_arr; }
+
+private:
+	Array *_arr;
+};
+
+// A Document is a root Value that hangs onto its storage from one parse to
+// the next. If you parse lots of documents with a similar shape (one request
+// after another, or records from a log), the strings, arrays, and objects
+// from the previous document are recycled, and once things warm up, parsing
+// hardly touches the heap at all. (See ParseContext::reuse_storage.) Example:
+//
+// Document doc;
+// while ( ReadNextRecord( &text ) )
+// {
+//   if ( doc.ParseJSON( text ) )
+//     HandleRecord( doc.Root() );
+//   doc.Reset();
+// }
+//
+// There is no allocator hook or arena. The DOM is made of plain std::map,
+// std::vector and std::string, which always use the global heap, so
+// recycling is how a Document avoids going back to it.
+class Document
+{
+public:
+	// Options for parsing, and errors from the last parse.
+	// (reuse_storage is always set.)
+	ParseContext ctx;
+
+	// Copying or moving a document gives the destination a new generation.
+	// Moving leaves the source null, with a new generation too. (The spare
+	// storage isn't copied.)
+	Document() {}
+	Document( const Document &x ) : ctx( x.ctx ), _root( x._root ) {}
+	Document( Document &&x );
+	Document &operator=( const Document &x );
+	Document &operator=( Document &&x );
+
+	inline bool ParseJSON( const char *c_str ) { return ParseJSON( c_str, c_str + strlen(c_str) ); }
+	inline bool ParseJSON( const std::string &s ) { return ParseJSON( s.c_str(), s.c_str() + s.length() ); }
+	bool ParseJSON( const char *begin, const char *end );
+	bool ParseFile( const char *filename );
+
+	// Access the document. You can modify it, and if you do, the next
+	// parse will try to recycle what's there.
+	Value       &Root()       { Touch(); return _root; }
+	const Value &Root() const { return _root; }
+
+	// Set the root to null, but keep its storage for the next parse. This
+	// doesn't free anything, so it's cheap no matter how big the document is.
+	void Reset();
+
+	// Free all the memory
+	void Release() { Touch(); _root.SetNull(); _spare.SetNull(); }
+
+	// A number that changes whenever the document might have changed: when
+	// it is parsed, reset, or released, or the non-const Root() is called.
+	// No two documents ever have the same generation. (If you hang on to
+	// the reference from Root() and modify the document later, call Touch(),
+	// or CachedPath lookups can return stale results.)
+	uint64_t Generation() const { return _generation; }
+	void Touch() { _generation = NextGeneration(); }
+
+private:
+	Value _root;
+	Value _spare; // Storage from the last document, after Reset()
+	uint64_t _generation = NextGeneration();
+	void Recycle();
+	static uint64_t NextGeneration();
+};
+
+// A JSON Pointer (RFC 6901), such as "/config/hosts/0/name", compiled
+// ahead of time. The pointer is split and unescaped once, and each key
+// gets its hash worked out, so looking up a Path is as fast as a chain of
+// *AtKey calls with Keys. See Value::AtPath, etc. An empty pointer ("")
+// refers to the whole document.
+class Path
+{
+public:
+	Path() {}
+	explicit Path( const char *pointer ) { Set( pointer, strlen( pointer ) ); }
+	explicit Path( const std::string &pointer ) { Set( pointer.c_str(), pointer.length() ); }
+
+	// Returns false if the pointer is malformed: it doesn't start with '/',
+	// or has a '~' that isn't "~0" or "~1". A malformed Path never finds
+	// anything.
+	bool Set( const char *pointer, size_t len );
+	bool IsValid() const { return _valid; }
+
+	// Number of steps. (0 for the whole document)
+	size_t size() const { return _steps.size(); }
+
+	// Look up the value. On failure, returns the error from the step where
+	// the lookup failed.
+	EResult Resolve( const Value &root, const Value **out ) const;
+	EResult Resolve( Value &root, Value **out ) const;
+
+private:
+	struct Step
+	{
+		std::string key; // Unescaped
+		uint32_t hash;
+		size_t index; // Or npos, if the key isn't an array index
+		Key AsKey() const { Key k; k.str = key.c_str(); k.len = key.length(); k.hash = hash; return k; }
+	};
+	std::vector<Step> _steps;
+	bool _valid = true;
+
+	template <typename V> EResult Walk( V &root, V **out ) const;
+};
+
+// A Path that remembers what it found the last time it was used on a
+// Document. Until the document's generation changes, looking it up again
+// costs one check. A CachedPath is not safe to share between threads; give
+// each thread its own copy.
+//
+// static thread_local vjson::CachedPath tBurst( "/config/limits/rate/burst" );
+// int burst = tBurst.In( doc ).AsInt( 10 );
+class CachedPath : public Path
+{
+public:
+	explicit CachedPath( const char *pointer ) : Path( pointer ) {}
+	explicit CachedPath( const std::string &pointer ) : Path( pointer ) {}
+
+	// Return the value, or nullptr if it isn't there
+	const Value *ValuePtrIn( const Document &doc ) const
+	{
+		if ( _doc != &doc || _generation != doc.Generation() )
+		{
+			_doc = &doc;
+			_generation = doc.Generation();
+			_node = doc.Root().ValuePtrAtPath( *this );
+		}
+		return _node;
+	}
+
+	// Return the value, or a null value if it isn't there
+	const Value &In( const Document &doc ) const { const Value *t = ValuePtrIn( doc ); return t ? *t : GetStaticNullValue(); }
+
+private:
+	mutable const Document *_doc = nullptr;
+	mutable uint64_t _generation = 0;
+	mutable const Value *_node = nullptr;
+};
+
+// A hash index over an array of objects (or any values), keyed by the
+// value at a path inside each element, for finding records by ID without
+// a linear scan. IDs are matched by their interpreted value, so the
+// number 42 and the string "42" are the same ID. (Non-negative integers
+// are compared as numbers, so "042" matches 42 too. Anything else is
+// compared as the string from TryInterpret.) Elements where the path
+// doesn't lead to a number, string or bool are not indexed. If more than
+// one element has the same ID, you get the first one.
+//
+// vjson::ArrayIndex byId( users, "/id" );
+// const vjson::Value *user = byId.Find( 1234 );
+//
+// The index refers to the array, so the array must outlive it. The array
+// notices when it is changed through Array methods, and lookups on a
+// non-const ArrayIndex bring the index up to date first: elements added
+// with push_back are indexed, and any other change (clear, Splice,
+// operator[], Raw(), assignment) rebuilds the index once. So a lookup,
+// hit or miss, costs one hash probe.
+//
+// A lookup on a const ArrayIndex never modifies it, so a const index can
+// be read by several threads at once, so long as nobody changes the array.
+// If the array has changed since the index was last brought up to date, a
+// const lookup checks the appended elements by hand, or after any other
+// change, scans the whole array. Call Sync() before sharing the index.
+//
+// The array can't see changes made to an element through a pointer or
+// reference you got earlier, or from a Value further up the document
+// (such as through AtPath). Call Update() or Rebuild() after those. Until
+// you do, the element isn't found by its new ID, though a stale entry for
+// its old ID is never returned.
+class ArrayIndex
+{
+public:
+	ArrayIndex( const Array &arr, const Path &path ) : _arr( &arr ), _path( path ) { Rebuild(); }
+	ArrayIndex( const Array &arr, const char *pointer ) : ArrayIndex( arr, Path( pointer ) ) {}
+
+	static constexpr size_t npos = (size_t)-1;
+
+	// Return the position of the first element with the ID, or npos
+	size_t IndexOf( const Value &id )             { Sync(); return ConstThis()->IndexOf( id ); }
+	size_t IndexOf( const Value &id ) const;
+	size_t IndexOf( const char *id )              { Sync(); return ConstThis()->IndexOf( id ); }
+	size_t IndexOf( const char *id ) const;
+	size_t IndexOf( const std::string &id )       { return IndexOf( id.c_str() ); }
+	size_t IndexOf( const std::string &id ) const { return IndexOf( id.c_str() ); }
+	size_t IndexOf( double id )                   { return IndexOf( Value( id ) ); }
+	size_t IndexOf( double id ) const             { return IndexOf( Value( id ) ); }
+
+	// Return the first element with the ID, or nullptr
+	template <typename T> const Value *Find( const T &id )       { size_t idx = IndexOf( id ); return idx == npos ? nullptr : &(*_arr)[ idx ]; }
+	template <typename T> const Value *Find( const T &id ) const { size_t idx = IndexOf( id ); return idx == npos ? nullptr : &(*_arr)[ idx ]; }
+
+	// Number of distinct IDs
+	size_t size() { Sync(); return _map.size(); }
+
+	// Bring the index up to date with the array. Appended elements are
+	// added, and after any other change, the index is rebuilt.
+	void Sync();
+
+	// Index everything again from scratch
+	void Rebuild();
+
+	// Tell the index that the element at idx was changed in place
+	void Update( size_t idx );
+
+private:
+	struct IndexKey
+	{
+		bool numeric;
+		uint64_t number;
+		std::string str;
+		bool operator==( const IndexKey &x ) const { return numeric == x.numeric && number == x.number && str == x.str; }
+	};
+	struct IndexKeyHash { size_t operator()( const IndexKey &k ) const; };
+
+	const Array *_arr;
+	Path _path;
+	std::unordered_map<IndexKey, size_t, IndexKeyHash> _map;
+	size_t _indexed = 0; // Elements [0,_indexed) are in the map
+	uint32_t _epoch = 0; // The array's epoch when we last synced
+
+	const ArrayIndex *ConstThis() const { return this; }
+	void Add( size_t idx );
+	bool KeyOfElement( size_t idx, IndexKey &out ) const;
+	size_t Lookup( const IndexKey &key ) const;
+	size_t Scan( const IndexKey &key, size_t first ) const;
+	static bool MakeKey( const Value &id, IndexKey &out );
+	static void MakeKey( const char *id, size_t len, IndexKey &out );
+};
+
+// Destroys Values on a background thread, so that the thread that drops a
+// big document doesn't have to wait while it gets freed. (Nothing else in
+// vjson creates threads, other than ThreadPool.)
+//
+// reclaimer.Reclaim( std::move( doc ) ); // O(1), doc is left empty, as with Destroy()
+class Reclaimer
+{
+public:
+	Reclaimer();
+	~Reclaimer(); // Waits for everything queued to be destroyed
+	Reclaimer( const Reclaimer & ) = delete;
+	Reclaimer &operator=( const Reclaimer & ) = delete;
+
+	// Take ownership of the value, and destroy it later
+	void Reclaim( Value &&x );
+
+	// Wait until everything queued so far has been destroyed
+	void Flush();
+
+private:
+	struct State;
+	State *_state;
+};
+
+// A small work-stealing thread pool, for the Parallel* algorithms below.
+// Make one and share it, since starting threads isn't cheap. The thread
+// that calls ParallelFor helps with the work, so a pool with no threads
+// just runs everything on the caller.
+class ThreadPool
+{
+public:
+	ThreadPool(); // One thread per core, less one for the caller
+	explicit ThreadPool( unsigned threads );
+	~ThreadPool();
+	ThreadPool( const ThreadPool & ) = delete;
+	ThreadPool &operator=( const ThreadPool & ) = delete;
+
+	// Number of worker threads
+	unsigned size() const;
+
+	// Call fn( begin, end ) on pieces of [0,n), in parallel, and wait for
+	// them all to finish. A range bigger than grain is split in half, and
+	// the halves are split again, and so on; idle threads steal the biggest
+	// pieces. Pieces of grain or fewer are run by whoever has them, without
+	// splitting. You can call this from inside fn. fn must not throw.
+	void ParallelFor( size_t n, size_t grain, const std::function<void( size_t begin, size_t end )> &fn );
+
+private:
+	struct State;
+	State *_state;
+};
+
+// Default number of elements in a piece, for the Parallel* algorithms
+constexpr size_t kParallelGrain = 1024;
+
+// Call fn on every element, in parallel. fn gets a Value &, or const
+// Value & if the array is const. Elements are visited in no particular
+// order, but each one exactly once, so fn may modify the element it is
+// given (and nothing else).
+template <typename Fn> void ParallelForEach( ThreadPool &pool, Array &arr, Fn &&fn, size_t grain = kParallelGrain );
+template <typename Fn> void ParallelForEach( ThreadPool &pool, const Array &arr, Fn &&fn, size_t grain = kParallelGrain );
+
+// Same thing, for object members. fn gets an ObjectItem (key and value).
+// The object can't be modified while this runs, other than the values.
+template <typename Fn> void ParallelForEach( ThreadPool &pool, Object &obj, Fn &&fn, size_t grain = kParallelGrain );
+template <typename Fn> void ParallelForEach( ThreadPool &pool, const Object &obj, Fn &&fn, size_t grain = kParallelGrain );
+
+// Replace every element with fn( element ), in parallel. fn can return
+// anything a Value can be assigned from.
+template <typename Fn> void ParallelTransform( ThreadPool &pool, Array &arr, Fn &&fn, size_t grain = kParallelGrain );
+
+// Set dst to an array with fn( x ) for every element x of src, in parallel
+template <typename Fn> void ParallelTransform( ThreadPool &pool, const Array &src, Array &dst, Fn &&fn, size_t grain = kParallelGrain );
+
+// Combine map( x ) for every element x, in parallel. identity must be an
+// identity for combine, like 0 for +. The elements are cut into pieces of
+// grain elements, each piece is combined in order, and then the pieces are
+// combined in order. That doesn't depend on the number of threads or on
+// timing, so the result is always the same, even for floating point.
+//
+// double total = ParallelReduce( pool, arr, 0.0, []( const Value &x ) { return x.AsDouble( 0.0 ); }, std::plus<double>() );
+template <typename T, typename Map, typename Combine> T ParallelReduce( ThreadPool &pool, const Array &arr, T identity, Map &&map, Combine &&combine, size_t grain = kParallelGrain );
+
+// Same thing, for object members. map gets an ObjectItem. The order is the
+// order that the object iterates in.
+template <typename T, typename Map, typename Combine> T ParallelReduce( ThreadPool &pool, const Object &obj, T identity, Map &&map, Combine &&combine, size_t grain = kParallelGrain );
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// JSON literals parsed at compile time
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// The parser relies on C++14's relaxed constexpr rules. FrozenDocument
+// shares the format, so it needs C++14 too.
+#if VJSON_HAVE_CPP14
+
+// Declare a read-only document from a string literal that is parsed by the
+// compiler. The result is a constant that lives in the read-only data segment:
+// nothing is parsed or allocated at runtime, and a malformed literal is a
+// compile error. (Look for a call to LiteralSyntaxError() in the error spew;
+// the message argument will tell you what is wrong.) Example:
+//
+// VJSON_LITERAL( kDefaults, R"JSON({
+//     "port": 8080,
+//     "hosts": [ "alpha", "beta" ],
+// })JSON" );
+//
+// int port = kDefaults.IntAtKey( "port", 80 );
+// static_assert( kDefaults.IntAtKey( "port", 80 ) == 8080, "Wrong default port" );
+//
+// Because these are meant to be hand-written, C++ comments and trailing
+// commas are always allowed. Use at namespace or function scope.
+#define VJSON_LITERAL( name, text ) \
+	static constexpr char name##_vjson_text[] = text; \
+	static constexpr ::vjson::LiteralDocument< \
+		::vjson::MeasureLiteral( name##_vjson_text ).nodes, \
+		::vjson::MeasureLiteral( name##_vjson_text ).chars \
+	> name##_vjson_doc{ name##_vjson_text, sizeof( name##_vjson_text ) }; \
+	static constexpr ::vjson::LiteralValue name = name##_vjson_doc.Root()
+
+// A LiteralValue is a read-only view of a node in a compile-time document
+// (or a FrozenDocument.)
+// It offers the same read accessors as Value, with the same "return a
+// default if anything is wrong" semantics. Since it is a view, functions
+// that return an Object or Array on Value return another LiteralValue here,
+// and lookups that fail return a view that is null (or an empty object or
+// array, for the XxxOrEmpty functions.)
+//
+// Differences from a parsed Value:
+// - Object members iterate in document order, not sorted by key.
+// - In a literal, key lookup is a linear scan. These are meant for small
+//   config blobs. In a FrozenDocument, it is a binary search.
+// - Duplicate keys are a compile error. (The runtime parser keeps the last one.)
+// - Numbers are converted by the compiler. Integers and "reasonable" decimal
+//   values are exact, but numbers with many digits or large exponents may
+//   differ from the runtime parser in the last bit.
+class LiteralValue
+{
+public:
+	constexpr LiteralValue() {}
+	constexpr LiteralValue( const LiteralNode *node, const char *chars, const uint32_t *index = nullptr ) : _node( node ), _chars( chars ), _index( index ) {}
+
+	// Type checking
+	constexpr EValueType Type() const { return _node ? _node->type : _missing_type; }
+	constexpr bool IsNull() const { return Type() == kNull; }
+	constexpr bool IsObject() const { return Type() == kObject; }
+	constexpr bool IsArray() const { return Type() == kArray; }
+	constexpr bool IsString() const { return Type() == kString; }
+	constexpr bool IsNumber() const { return Type() == kDouble; }
+	constexpr bool IsDouble() const { return Type() == kDouble; }
+	constexpr bool IsBool() const { return Type() == kBool; }
+
+	// Get this value as the specified type. If the value is not the exact
+	// JSON type, returns a default. No conversions are attempted.
+	constexpr const char *AsCString( const char *defaultVal ) const { return NodeIs( kString ) ? _chars + _node->offset : defaultVal; }
+	std::string           AsString ( const char *defaultVal ) const { return NodeIs( kString ) ? std::string( _chars + _node->offset, _node->len ) : std::string( defaultVal ); }
+	constexpr bool        AsBool   ( bool        defaultVal ) const { return NodeIs( kBool ) ? _node->len != 0 : defaultVal; }
+	constexpr double      AsDouble ( double      defaultVal ) const { return NodeIs( kDouble ) ? _node->number : defaultVal; }
+	constexpr int         AsInt    ( int         defaultVal ) const { return NodeIs( kDouble ) ? (int)_node->number : defaultVal; }
+	constexpr LiteralValue AsObjectOrEmpty() const { return IsObject() ? *this : Missing( kObject ); }
+	constexpr LiteralValue AsArrayOrEmpty () const { return IsArray()  ? *this : Missing( kArray ); }
+
+	// String length in bytes, or 0 if this is not a string.
+	constexpr size_t StringLen() const { return NodeIs( kString ) ? _node->len : 0; }
+
+	//
+	// Object access
+	//
+
+	constexpr int    ObjectLen () const { return NodeIs( kObject ) ? (int)_node->len : 0; }
+	constexpr size_t ObjectSize() const { return NodeIs( kObject ) ? _node->len : 0; }
+	constexpr bool   HasKey( const char *key ) const { return FindKey( key ) != nullptr; }
+	constexpr bool   HasKey( const Key  &key ) const { return FindKey( key ) != nullptr; }
+
+	// Returns a null value if this is not an object or the key is not found.
+	// In a literal, a Key is faster, since most keys can be skipped just by
+	// comparing the length.
+	constexpr LiteralValue AtKey( const char *key ) const { return LiteralValue( FindKey( key ), _chars, _index ); }
+	constexpr LiteralValue AtKey( const Key  &key ) const { return LiteralValue( FindKey( key ), _chars, _index ); }
+
+	template <typename K> constexpr const char * CStringAtKey      ( K &&key, const char *defaultVal ) const { return AtKey( key ).AsCString( defaultVal ); }
+	template <typename K> std::string            StringAtKey       ( K &&key, const char *defaultVal ) const { return AtKey( key ).AsString( defaultVal ); }
+	template <typename K> constexpr bool         BoolAtKey         ( K &&key, bool        defaultVal ) const { return AtKey( key ).AsBool( defaultVal ); }
+	template <typename K> constexpr double       DoubleAtKey       ( K &&key, double      defaultVal ) const { return AtKey( key ).AsDouble( defaultVal ); }
+	template <typename K> constexpr int          IntAtKey          ( K &&key, int         defaultVal ) const { return AtKey( key ).AsInt( defaultVal ); }
+	template <typename K> constexpr LiteralValue ArrayAtKeyOrEmpty ( K &&key                         ) const { return AtKey( key ).AsArrayOrEmpty(); }
+	template <typename K> constexpr LiteralValue ObjectAtKeyOrEmpty( K &&key                         ) const { return AtKey( key ).AsObjectOrEmpty(); }
+
+	//
+	// Array access
+	//
+
+	constexpr int    ArrayLen () const { return NodeIs( kArray ) ? (int)_node->len : 0; }
+	constexpr size_t ArraySize() const { return NodeIs( kArray ) ? _node->len : 0; }
+
+	// Returns a null value if this is not an array or the index is out of range
+	constexpr LiteralValue AtIndex( size_t idx ) const { return LiteralValue( FindIndex( idx ), _chars, _index ); }
+
+	constexpr const char * CStringAtIndex      ( size_t idx, const char *defaultVal ) const { return AtIndex( idx ).AsCString( defaultVal ); }
+	std::string            StringAtIndex       ( size_t idx, const char *defaultVal ) const { return AtIndex( idx ).AsString( defaultVal ); }
+	constexpr bool         BoolAtIndex         ( size_t idx, bool        defaultVal ) const { return AtIndex( idx ).AsBool( defaultVal ); }
+	constexpr double       DoubleAtIndex       ( size_t idx, double      defaultVal ) const { return AtIndex( idx ).AsDouble( defaultVal ); }
+	constexpr int          IntAtIndex          ( size_t idx, int         defaultVal ) const { return AtIndex( idx ).AsInt( defaultVal ); }
+	constexpr LiteralValue ArrayAtIndexOrEmpty ( size_t idx                         ) const { return AtIndex( idx ).AsArrayOrEmpty(); }
+	constexpr LiteralValue ObjectAtIndexOrEmpty( size_t idx                         ) const { return AtIndex( idx ).AsObjectOrEmpty(); }
+
+	//
+	// Iteration
+	//
+
+	// Iterate the elements of an array. Does nothing if this is not an array.
+	//
+	// for ( vjson::LiteralValue v: kDefaults.ArrayAtKeyOrEmpty( "hosts" ) ) {}
+	LiteralIter<LiteralValue> begin() const;
+	LiteralIter<LiteralValue> end() const;
+
+	// Iterate only the elements of the array that are of the specified
+	// type, like Array::Iter. Iter<Object>() and Iter<Array>() give you
+	// LiteralValues.
+	//
+	// for ( double x: frozen.Root().Iter<double>() ) {}
+	template <typename T> LiteralRange<T> Iter() const;
+
+	// Template-style access for Iter<T>. If the value is not the right
+	// type, returns the same default as the AsXxx functions would with
+	// a default of zero, "", or an empty object or array.
+	template <typename T> typename TypeTraits<T>::LiteralType Get() const;
+
+	// Iterate the key/value pairs of an object. Does nothing if this is not an object.
+	//
+	// for ( vjson::LiteralMember item: kDefaults.Members() ) { item.first; item.second; }
+	LiteralRange<LiteralMember> Members() const;
+
+	//
+	// Conversion
+	//
+
+	// Make a regular, mutable Value with a copy of this data.
+	// (E.g. to start with the defaults, and then apply overrides.)
+	Value ToValue() const;
+
+	// Print the value to JSON text.
+	std::string PrintJSON( const PrintOptions &opt = PrintOptions{} ) const { return ToValue().PrintJSON( opt ); }
+
+private:
+	const LiteralNode *_node = nullptr;
+	const char *_chars = nullptr;
+	const uint32_t *_index = nullptr; // Sorted keys of objects in a FrozenDocument. (Literals don't have one)
+	EValueType _missing_type = kNull; // What we claim to be when _node is null
+
+	constexpr bool NodeIs( EValueType t ) const { return _node && _node->type == t; }
+	static constexpr LiteralValue Missing( EValueType t ) { LiteralValue x; x._missing_type = t; return x; }
+	constexpr const LiteralNode *FindKey( const char *key ) const;
+	constexpr const LiteralNode *FindKey( const Key &key ) const;
+	const LiteralNode *FindIndexedKey( const char *key, size_t len ) const;
+	constexpr const LiteralNode *FindIndex( size_t idx ) const;
+};
+
+// Key/value pair you get when you iterate LiteralValue::Members()
+struct LiteralMember
+{
+	const char *first; // key
+	LiteralValue second; // value
+};
+
+// A read-only document, built at runtime, in the same format as a
+// VJSON_LITERAL: one flat array of nodes, plus one buffer with all of the
+// characters. Each object also gets a list of its members sorted by key,
+// so looking up a key is a binary search. Use this for data that is loaded
+// once and then only read. Traversal walks forward through memory,
+// destroying it is three calls to free(), and there are only three blocks
+// for the allocator to track. It is not a compact encoding, though: each
+// node is sizeof(LiteralNode) (40) bytes, plus 4 bytes of index for each
+// object member. Compared to a tree of Values in the default layout, it is
+// only about 25% smaller, and with VJSON_COMPACT_VALUE it is about the same
+// size. You access it through the LiteralValue interface.
+class FrozenDocument
+{
+public:
+	FrozenDocument() {}
+	explicit FrozenDocument( const Value &x ) { Freeze( x ); }
+
+	// Make a frozen copy of a Value, replacing whatever we held before
+	void Freeze( const Value &x );
+
+	// Parse JSON text. On failure, the document is null. This does not
+	// build a Value: the text is parsed twice, once to measure, and once to
+	// fill in buffers of exactly the right size. As with Value, if a key is
+	// duplicated, the last one wins.
+	inline bool ParseJSON( const char *c_str, ParseContext *ctx = nullptr ) { return ParseJSON( c_str, c_str + strlen(c_str), ctx ); }
+	inline bool ParseJSON( const std::string &s, ParseContext *ctx = nullptr ) { return ParseJSON( s.c_str(), s.c_str() + s.length(), ctx ); }
+	bool ParseJSON( const char *begin, const char *end, ParseContext *ctx = nullptr );
+	bool ParseFile( const char *filename, ParseContext *ctx = nullptr );
+
+	// Access the document. The views are invalidated if the document is
+	// re-frozen or destroyed.
+	LiteralValue Root() const { return _nodes.empty() ? LiteralValue() : LiteralValue( _nodes.data(), _chars.data(), _index.data() ); }
+
+	// Free all memory. The document is null.
+	void clear() { _nodes.clear(); _nodes.shrink_to_fit(); _chars.clear(); _chars.shrink_to_fit(); _index.clear(); _index.shrink_to_fit(); }
+
+private:
+	std::vector<LiteralNode> _nodes;
+	std::string _chars;
+	std::vector<uint32_t> _index; // For each object, offsets of its keys (from the object node), sorted by key
+};
+
+#endif // #if VJSON_HAVE_CPP14
+
+// An object that is built once and then only looked up, such as a routing
+// table. Lookup uses a minimal perfect hash over the keys, so it costs one
+// hash of the key you are looking for, and one key comparison, no matter
+// how many items there are. Only the top level is frozen; the values are
+// ordinary Values. Items are in no particular order.
+//
+// Example:
+//
+// vjson::FrozenObject routes = obj.Freeze();
+// const vjson::Value *r = routes.ValuePtrAtKey( "/index.html" );
+class FrozenObject
+{
+public:
+	typedef std::pair<std::string, Value> value_type;
+	typedef std::vector<value_type>::const_iterator const_iterator;
+
+	FrozenObject() {}
+	explicit FrozenObject( const Object &obj );
+	explicit FrozenObject( Object &&obj );
+
+	// Lookup.  Returns nullptr if the key isn't present
+	const Value *ValuePtrAtKey( const char *key ) const { return Find( key, strlen( key ) ); }
+	const Value *ValuePtrAtKey( const std::string &key ) const { return Find( key.c_str(), key.length() ); }
+	const Value *ValuePtrAtKey( const Key &key ) const { return Find( key.str, key.len ); }
+	#if VJSON_HAVE_CPP17
+		const Value *ValuePtrAtKey( std::string_view key ) const { return Find( key.data(), key.size() ); }
+	#endif
+	template <typename K> bool HasKey( K &&key ) const { return ValuePtrAtKey( key ) != nullptr; }
+	template <typename K> const Value &AtKey( K &&key ) const { const Value *t = ValuePtrAtKey( key ); return t ? *t : GetStaticNullValue(); }
+
+	// Get the value at the key as the specified type, or a default. These
+	// work just like the ones on Value. (See Value::IntAtKey, etc.)
+	template <typename K> const char *  CStringAtKey      ( K &&key, const char *       defaultVal ) const { return AtKey( key ).AsCString( defaultVal ); }
+	template <typename K> std::string   StringAtKey       ( K &&key, const char *       defaultVal ) const { return AtKey( key ).AsString( defaultVal ); } // NOTE: always returns a copy
+	template <typename K> std::string   StringAtKey       ( K &&key, const std::string &defaultVal ) const { return AtKey( key ).AsString( defaultVal ); } // NOTE: always returns a copy
+	template <typename K> std::string   StringAtKey       ( K &&key, std::string &&     defaultVal ) const { return AtKey( key ).AsString( std::forward<std::string>( defaultVal ) ); } // Avoids copy
+	#if VJSON_HAVE_CPP17
+	template <typename K> std::string_view StringViewAtKey( K &&key, std::string_view   defaultVal ) const { return AtKey( key ).AsStringView( defaultVal ); } // No copy
+	#endif
+	template <typename K> bool          BoolAtKey         ( K &&key, bool               defaultVal ) const { return AtKey( key ).AsBool( defaultVal ); } // Requires strict bool type!
+	template <typename K> double        DoubleAtKey       ( K &&key, double             defaultVal ) const { return AtKey( key ).AsDouble( defaultVal ); }
+	template <typename K> int           IntAtKey          ( K &&key, int                defaultVal ) const { return AtKey( key ).AsInt( defaultVal ); }
+	template <typename K> const Object *ObjectPtrAtKey    ( K &&key                                ) const { return AtKey( key ).AsObjectPtr(); }
+	template <typename K> const Array * ArrayPtrAtKey     ( K &&key                                ) const { return AtKey( key ).AsArrayPtr(); }
+	template <typename K> const Array  &ArrayAtKeyOrEmpty ( K &&key                                ) const { return AtKey( key ).AsArrayOrEmpty(); }
+	template <typename K> const Object &ObjectAtKeyOrEmpty( K &&key                                ) const { return AtKey( key ).AsObjectOrEmpty(); }
+
+	size_t size() const { return _items.size(); }
+	bool empty() const { return _items.empty(); }
+	const_iterator begin() const { return _items.begin(); }
+	const_iterator end() const { return _items.end(); }
+
+	// Move all the items back into an ordinary Object, which can be
+	// modified. We are left empty.
+	Object Thaw();
+
+private:
+	void Build();
+	const Value *Find( const char *key, size_t len ) const;
+
+	std::vector<value_type> _items; // In hash order
+	std::vector<uint64_t> _hashes; // Parallel to _items
+	std::vector<uint32_t> _seeds; // Per bucket.  Picks the slot for the keys in that bucket
+	bool _linear = false; // Couldn't build a perfect hash.  (Only if two keys have the same 64-bit hash!)
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -650,6 +2092,30 @@ public:
 //
 /////////////////////////////////////////////////////////////////////////////
 
+#if VJSON_FLAT_OBJECT
+inline size_t FlatObject::size() const { return _entries.size(); }
+inline bool FlatObject::empty() const { return _entries.empty(); }
+inline size_t FlatObject::capacity() const { return _entries.capacity(); }
+inline void FlatObject::reserve( size_t n ) { _entries.reserve( n ); _hashes.reserve( n ); }
+inline void FlatObject::shrink_to_fit() { _entries.shrink_to_fit(); _hashes.shrink_to_fit(); }
+inline size_t FlatObject::index_bytes() const { return ( _hashes.capacity() + _index.capacity() ) * sizeof(uint32_t); }
+inline void FlatObject::clear() { _entries.clear(); _hashes.clear(); _index.clear(); }
+inline void FlatObject::swap( FlatObject &x ) { _entries.swap( x._entries ); _hashes.swap( x._hashes ); _index.swap( x._index ); }
+inline FlatObject::iterator FlatObject::begin() { return _entries.begin(); }
+inline FlatObject::iterator FlatObject::end() { return _entries.end(); }
+inline FlatObject::const_iterator FlatObject::begin() const { return _entries.begin(); }
+inline FlatObject::const_iterator FlatObject::end() const { return _entries.end(); }
+
+template <typename... A>
+Value &FlatObject::emplace_new( std::string &&key, uint32_t hash, A&&... args )
+{
+	_entries.emplace_back( std::piecewise_construct, std::forward_as_tuple( std::move( key ) ), std::forward_as_tuple( std::forward<A>( args )... ) );
+	_hashes.push_back( hash );
+	IndexAdded();
+	return _entries.back().second;
+}
+#endif
+
 template<> inline bool Value::Is<std::nullptr_t>() const { return _type == kNull; }
 template<> inline bool Value::Is<Object>() const { return _type == kObject; }
 template<> inline bool Value::Is<Array>() const { return _type == kArray; }
@@ -657,10 +2123,10 @@ template<> inline bool Value::Is<const char *>() const { return _type == kString
 template<> inline bool Value::Is<std::string>() const { return _type == kString; }
 template<> inline bool Value::Is<double>() const { return _type == kDouble; }
 template<> inline bool Value::Is<bool>() const { return _type == kBool; }
-template<> inline const char * Value::Get<const char *>() const { VJSON_ASSERT( _type == kString ); return _string.c_str(); }
-template<> inline const char * Value::Get<const char *>() { VJSON_ASSERT( _type == kString ); return _string.c_str(); }
-template<> inline const std::string &Value::Get<std::string>() const { VJSON_ASSERT( _type == kString ); return _string; }
-template<> inline std::string & Value::Get<std::string>() { VJSON_ASSERT( _type == kString ); return _string; }
+template<> inline const char * Value::Get<const char *>() const { VJSON_ASSERT( _type == kString ); return RawStr().c_str(); }
+template<> inline const char * Value::Get<const char *>() { VJSON_ASSERT( _type == kString ); return ConstThis()->RawStr().c_str(); }
+template<> inline const std::string &Value::Get<std::string>() const { VJSON_ASSERT( _type == kString ); return RawStr(); }
+template<> inline std::string & Value::Get<std::string>() { VJSON_ASSERT( _type == kString ); return RawStr(); }
 template<> inline const bool & Value::Get<bool>() const { VJSON_ASSERT( _type == kBool ); return _bool; } // NOTE: requires exact bool type!
 template<> inline bool & Value::Get<bool>() { VJSON_ASSERT( _type == kBool ); return _bool; } // NOTE: requires exact bool type!
 template<> inline const double & Value::Get<double>() const { VJSON_ASSERT( _type == kDouble ); return _double; }
@@ -676,15 +2142,38 @@ template <typename T, typename K>
 inline EResult Value::SetAtKey( K&& key, T&& value )
 {
 	if ( _type != kObject ) return kNotObject;
-	_object[ std::forward<K>( key ) ] = std::forward<T>( value );
+	RawObj()[ KeyToInsert( std::forward<K>( key ) ) ] = std::forward<T>( value );
 	return kOK;
 }
 
+template <typename K>
+ObjectNode Object::Extract( K &&key )
+{
+	VJSON_ASSERT( _type == kObject );
+	RawObject &raw = RawObj();
+	auto it = raw.find( KeyToFind( key ) );
+	if ( it == raw.end() )
+		return ObjectNode();
+	#if VJSON_HAVE_CPP17 && !VJSON_FLAT_OBJECT
+		return raw.extract( it );
+	#else
+		#if VJSON_FLAT_OBJECT
+			ObjectNode node( std::move( it->first ), std::move( it->second ) );
+		#else
+			ObjectNode node( std::string( it->first ), std::move( it->second ) ); // Map keys are const
+		#endif
+		raw.erase( it );
+		return node;
+	#endif
+}
+
 template <typename K>
 EResult Value::EraseAtKey( K&& key )
 {
 	if ( _type != kObject ) return kNotObject;
-	if ( _object.erase( std::forward<K>( key ) ) == 0 ) return kBadKey;
+	auto it = RawObj().find( KeyToFind( key ) );
+	if ( it == RawObj().end() ) return kBadKey;
+	RawObj().erase( it );
 	return kOK;
 }
 
@@ -692,26 +2181,211 @@ template <typename K, typename T>
 EResult Value::TryInterpretAtKey( K&& key, T &outResult ) const
 {
 	if ( _type != kObject ) return kNotObject;
-	auto it = _object.find( key );
-	if ( it == _object.end() ) return kBadKey;
-	return it->second.TryInterpret( outResult );
+	const Value *v = ValuePtrAtKey( key );
+	if ( !v ) return kBadKey;
+	return v->TryInterpret( outResult );
+}
+
+template <typename Fn>
+void ParallelForEach( ThreadPool &pool, Array &arr, Fn &&fn, size_t grain )
+{
+	Value *items = arr.begin();
+	pool.ParallelFor( arr.size(), grain, [items, &fn]( size_t b, size_t e ) { for ( size_t i = b ; i < e ; ++i ) fn( items[i] ); } );
+}
+
+template <typename Fn>
+void ParallelForEach( ThreadPool &pool, const Array &arr, Fn &&fn, size_t grain )
+{
+	const Value *items = arr.begin();
+	pool.ParallelFor( arr.size(), grain, [items, &fn]( size_t b, size_t e ) { for ( size_t i = b ; i < e ; ++i ) fn( items[i] ); } );
+}
+
+template <typename Fn>
+void ParallelForEach( ThreadPool &pool, Object &obj, Fn &&fn, size_t grain )
+{
+	// Map iterators aren't random access, so make a list
+	std::vector<ObjectItem *> items;
+	items.reserve( obj.size() );
+	for ( ObjectItem &item: obj )
+		items.push_back( &item );
+	pool.ParallelFor( items.size(), grain, [&items, &fn]( size_t b, size_t e ) { for ( size_t i = b ; i < e ; ++i ) fn( *items[i] ); } );
+}
+
+template <typename Fn>
+void ParallelForEach( ThreadPool &pool, const Object &obj, Fn &&fn, size_t grain )
+{
+	std::vector<const ObjectItem *> items;
+	items.reserve( obj.size() );
+	for ( const ObjectItem &item: obj )
+		items.push_back( &item );
+	pool.ParallelFor( items.size(), grain, [&items, &fn]( size_t b, size_t e ) { for ( size_t i = b ; i < e ; ++i ) fn( *items[i] ); } );
+}
+
+template <typename Fn>
+void ParallelTransform( ThreadPool &pool, Array &arr, Fn &&fn, size_t grain )
+{
+	Value *items = arr.begin();
+	pool.ParallelFor( arr.size(), grain, [items, &fn]( size_t b, size_t e ) { for ( size_t i = b ; i < e ; ++i ) items[i] = fn( (const Value &)items[i] ); } );
+}
+
+template <typename Fn>
+void ParallelTransform( ThreadPool &pool, const Array &src, Array &dst, Fn &&fn, size_t grain )
+{
+	VJSON_ASSERT( &src != &dst );
+	dst.SetEmptyArray();
+	dst.Raw().resize( src.size() );
+	const Value *in = src.begin();
+	Value *out = dst.begin();
+	pool.ParallelFor( src.size(), grain, [in, out, &fn]( size_t b, size_t e ) { for ( size_t i = b ; i < e ; ++i ) out[i] = fn( in[i] ); } );
+}
+
+template <typename T, typename Get, typename Map, typename Combine>
+T InternalParallelReduce( ThreadPool &pool, size_t n, const Get &get, T identity, Map &map, Combine &combine, size_t grain )
+{
+	// Fixed pieces, combined in a fixed order
+	if ( grain == 0 )
+		grain = 1;
+	size_t pieces = ( n + grain - 1 ) / grain;
+	struct Partial { T value; }; // Not vector<T>, in case T is bool
+	std::vector<Partial> partial( pieces, Partial{ identity } );
+	pool.ParallelFor( pieces, 1, [&]( size_t b, size_t e )
+	{
+		for ( size_t p = b ; p < e ; ++p )
+		{
+			T acc = identity;
+			size_t last = (p+1)*grain < n ? (p+1)*grain : n;
+			for ( size_t i = p*grain ; i < last ; ++i )
+				acc = combine( std::move( acc ), map( get( i ) ) );
+			partial[p].value = std::move( acc );
+		}
+	} );
+	T result = std::move( identity );
+	for ( Partial &p: partial )
+		result = combine( std::move( result ), std::move( p.value ) );
+	return result;
+}
+
+template <typename T, typename Map, typename Combine>
+T ParallelReduce( ThreadPool &pool, const Array &arr, T identity, Map &&map, Combine &&combine, size_t grain )
+{
+	const Value *items = arr.begin();
+	return InternalParallelReduce( pool, arr.size(), [items]( size_t i ) -> const Value & { return items[i]; }, std::move( identity ), map, combine, grain );
+}
+
+template <typename T, typename Map, typename Combine>
+T ParallelReduce( ThreadPool &pool, const Object &obj, T identity, Map &&map, Combine &&combine, size_t grain )
+{
+	std::vector<const ObjectItem *> items;
+	items.reserve( obj.size() );
+	for ( const ObjectItem &item: obj )
+		items.push_back( &item );
+	return InternalParallelReduce( pool, items.size(), [&items]( size_t i ) -> const ObjectItem & { return *items[i]; }, std::move( identity ), map, combine, grain );
+}
+
+inline void ObjectBuilder::Reserve( size_t n )
+{
+	#if VJSON_FLAT_OBJECT
+		RawObject &raw = _obj->Raw();
+		raw.reserve( raw.size() + n );
+	#else
+		(void)n;
+	#endif
+}
+
+template <typename K, typename... A>
+Value &ObjectBuilder::Emplace( K &&key, A&&... args )
+{
+	RawObject &raw = _obj->Raw();
+	#if VJSON_FLAT_OBJECT
+		std::string k( KeyToInsert( std::forward<K>( key ) ) );
+		uint32_t hash = HashKey( k.c_str(), k.length() );
+		Key lookup; lookup.str = k.c_str(); lookup.len = k.length(); lookup.hash = hash;
+		auto it = raw.find( lookup );
+		if ( it != raw.end() )
+		{
+			it->second = Value( std::forward<A>( args )... );
+			return it->second;
+		}
+		return raw.emplace_new( std::move( k ), hash, std::forward<A>( args )... );
+	#else
+		// Find where it goes, and use that as the hint, so the insert doesn't search again
+		auto it = raw.lower_bound( key );
+		if ( it != raw.end() && !ObjectKeyLess()( key, it->first ) )
+		{
+			it->second = Value( std::forward<A>( args )... );
+			return it->second;
+		}
+		return raw.emplace_hint( it, std::piecewise_construct, std::forward_as_tuple( KeyToInsert( std::forward<K>( key ) ) ), std::forward_as_tuple( std::forward<A>( args )... ) )->second;
+	#endif
+}
+
+template <typename K, typename... A>
+Value &ObjectBuilder::EmplaceSorted( K &&key, A&&... args )
+{
+	RawObject &raw = _obj->Raw();
+	#if VJSON_FLAT_OBJECT
+		std::string k( KeyToInsert( std::forward<K>( key ) ) );
+		VJSON_ASSERT( raw.find( k ) == raw.end() );
+		uint32_t hash = HashKey( k.c_str(), k.length() );
+		return raw.emplace_new( std::move( k ), hash, std::forward<A>( args )... );
+	#else
+		// Inserting right before end() with end() as the hint doesn't search
+		VJSON_ASSERT( raw.empty() || ObjectKeyLess()( raw.rbegin()->first, key ) );
+		return raw.emplace_hint( raw.end(), std::piecewise_construct, std::forward_as_tuple( KeyToInsert( std::forward<K>( key ) ) ), std::forward_as_tuple( std::forward<A>( args )... ) )->second;
+	#endif
+}
+
+template <typename K>
+ArrayBuilder ObjectBuilder::EmplaceArray( K &&key )
+{
+	return ArrayBuilder( Emplace( std::forward<K>( key ), kArray ) );
+}
+
+template <typename... T>
+size_t Value::GetAtKeys( const KeySet &keys, T &... out ) const
+{
+	VJSON_ASSERT( keys.size() == sizeof...(T) );
+	const Value *ptrs[ sizeof...(T) + 1 ];
+	if ( keys.size() != sizeof...(T) || ValuePtrsAtKeys( keys, ptrs ) == 0 )
+		return 0;
+	size_t n = 0, i = 0;
+	int expand[] = { 0, ( n += AssignIfType( ptrs[i++], out ) ? 1 : 0, 0 )... };
+	(void)expand;
+	return n;
+}
+
+#if VJSON_HAVE_CPP14
+template <typename... T>
+std::tuple<T...> Value::TupleAtKeys( const KeySet &keys, T... defaults ) const
+{
+	std::tuple<T...> result( std::move( defaults )... );
+	InternalTupleAtKeys( keys, result, std::index_sequence_for<T...>() );
+	return result;
+}
+#endif
+
+template <typename T>
+EResult Value::TryInterpretAtPath( const Path &path, T &outResult ) const
+{
+	const Value *v;
+	EResult r = path.Resolve( *this, &v );
+	if ( r != kOK ) return r;
+	return v->TryInterpret( outResult );
 }
 
 template <typename T>
 EResult Value::TryInterpretAtIndex( size_t idx, T &outResult ) const
 {
 	if ( _type != kArray ) return kNotArray;
-	if ( idx >= _array.size() ) return kBadIndex;
-	return _array[ idx ].TryInterpret( outResult );
+	if ( idx >= RawArr().size() ) return kBadIndex;
+	return RawArr()[ idx ].TryInterpret( outResult );
 }
 
 template <typename T>
 void Value::SetArray( const T *begin, const T *end )
 {
 	VJSON_ASSERT( begin <= end );
-	InternalDestruct();
-	_type = kArray;
-	new (&_array) RawArray( begin, end );
+	*this = RawArray( begin, end );
 }
 
 template<typename T, typename V, typename A, typename R>
@@ -744,8 +2418,525 @@ template<typename T, typename A, typename I> struct ArrayRange
 	I end() const { return I{array_ref,array_ref.data()+array_ref.size()}; }
 };
 
-template <typename T> ConstArrayRange<T> Array::Iter() const { return ConstArrayRange<T>{this->_array}; }
-template <typename T> MutableArrayRange<T> Array::Iter() { return MutableArrayRange<T>{this->_array}; }
+template <typename T> ConstArrayRange<T> Array::Iter() const { return ConstArrayRange<T>{this->RawArr()}; }
+template <typename T> MutableArrayRange<T> Array::Iter() { return MutableArrayRange<T>{this->RawArr()}; }
+
+//
+// Compile-time literals. Unfortunately, the parser has to live in the
+// header for this to work.
+//
+
+#if VJSON_HAVE_CPP14
+
+template<> struct LiteralIter<LiteralValue>
+{
+	const LiteralNode *node;
+	const char *chars;
+	const uint32_t *index;
+	LiteralValue operator*() const { return LiteralValue( node, chars, index ); }
+	void operator++() { node += node->size; }
+	bool operator!=( const LiteralIter &x ) const { return node != x.node; }
+};
+template<> struct LiteralIter<LiteralMember>
+{
+	const LiteralNode *node; // Points at the key. The value is the next node
+	const char *chars;
+	const uint32_t *index;
+	LiteralMember operator*() const { return LiteralMember{ chars + node->offset, LiteralValue( node+1, chars, index ) }; }
+	void operator++() { node += 1 + node[1].size; }
+	bool operator!=( const LiteralIter &x ) const { return node != x.node; }
+};
+template<typename T> struct LiteralIter // Elements of type T. See LiteralValue::Iter
+{
+	const LiteralNode *node;
+	const LiteralNode *end;
+	const char *chars;
+	const uint32_t *index;
+	typename TypeTraits<T>::LiteralType operator*() const { return LiteralValue( node, chars, index ).template Get<T>(); }
+	void operator++() { node += node->size; Next(); }
+	bool operator!=( const LiteralIter &x ) const { return node != x.node; }
+	void Next()
+	{
+		while ( node < end && node->type != TypeTraits<T>::kType )
+			node += node->size;
+	}
+};
+template<typename T> struct LiteralRange
+{
+	LiteralIter<T> b, e;
+	LiteralIter<T> begin() const { return b; }
+	LiteralIter<T> end() const { return e; }
+};
+
+inline LiteralIter<LiteralValue> LiteralValue::begin() const { return LiteralIter<LiteralValue>{ NodeIs( kArray ) ? _node+1 : nullptr, _chars, _index }; }
+inline LiteralIter<LiteralValue> LiteralValue::end() const { return LiteralIter<LiteralValue>{ NodeIs( kArray ) ? _node+_node->size : nullptr, _chars, _index }; }
+inline LiteralRange<LiteralMember> LiteralValue::Members() const
+{
+	if ( !NodeIs( kObject ) )
+		return LiteralRange<LiteralMember>{ { nullptr, _chars, _index }, { nullptr, _chars, _index } };
+	return LiteralRange<LiteralMember>{ { _node+1, _chars, _index }, { _node+_node->size, _chars, _index } };
+}
+template <typename T> LiteralRange<T> LiteralValue::Iter() const
+{
+	const LiteralNode *b = NodeIs( kArray ) ? _node+1 : nullptr;
+	const LiteralNode *e = NodeIs( kArray ) ? _node+_node->size : nullptr;
+	LiteralRange<T> r{ { b, e, _chars, _index }, { e, e, _chars, _index } };
+	r.b.Next();
+	return r;
+}
+template<> inline bool         LiteralValue::Get<bool>() const { return AsBool( false ); }
+template<> inline double       LiteralValue::Get<double>() const { return AsDouble( 0.0 ); }
+template<> inline int          LiteralValue::Get<int>() const { return AsInt( 0 ); }
+template<> inline const char * LiteralValue::Get<const char *>() const { return AsCString( "" ); }
+template<> inline std::string  LiteralValue::Get<std::string>() const { return AsString( "" ); }
+template<> inline LiteralValue LiteralValue::Get<Object>() const { return AsObjectOrEmpty(); }
+template<> inline LiteralValue LiteralValue::Get<Array>() const { return AsArrayOrEmpty(); }
+
+constexpr const LiteralNode *LiteralValue::FindKey( const char *key ) const
+{
+	if ( !NodeIs( kObject ) )
+		return nullptr;
+	if ( _index )
+		return FindIndexedKey( key, strlen( key ) );
+	const LiteralNode *k = _node+1;
+	for ( size_t i = 0 ; i < _node->len ; ++i )
+	{
+		const char *s = _chars + k->offset;
+		size_t j = 0;
+		while ( j < k->len && key[j] != '\0' && s[j] == key[j] ) // The stored key may contain nulls, so stop at the end of ours
+			++j;
+		if ( j == k->len && key[j] == '\0' )
+			return k+1;
+		k += 1 + k[1].size;
+	}
+	return nullptr;
+}
+
+constexpr const LiteralNode *LiteralValue::FindKey( const Key &key ) const
+{
+	if ( !NodeIs( kObject ) )
+		return nullptr;
+	if ( _index )
+		return FindIndexedKey( key.str, key.len );
+	const LiteralNode *k = _node+1;
+	for ( size_t i = 0 ; i < _node->len ; ++i )
+	{
+		if ( k->len == key.len )
+		{
+			const char *s = _chars + k->offset;
+			size_t j = 0;
+			while ( j < key.len && s[j] == key.str[j] )
+				++j;
+			if ( j == key.len )
+				return k+1;
+		}
+		k += 1 + k[1].size;
+	}
+	return nullptr;
+}
+
+constexpr const LiteralNode *LiteralValue::FindIndex( size_t idx ) const
+{
+	if ( !NodeIs( kArray ) || idx >= _node->len )
+		return nullptr;
+	const LiteralNode *v = _node+1;
+	while ( idx-- > 0 )
+		v += v->size;
+	return v;
+}
+
+// This is deliberately not constexpr. If the compiler tells you that you
+// called it in a constant expression, then your JSON literal is malformed,
+// and msg tells you why.
+inline bool LiteralSyntaxError( const char *msg ) { VJSON_ASSERT( !"Malformed JSON literal" ); (void)msg; return false; }
+
+// Recursive descent parser that runs inside the compiler. We make two
+// passes. The first pass is only to count how many nodes and characters
+// we need (nodes and chars are null). The second pass fills them in.
+struct LiteralParser
+{
+	const char *ptr;
+	const char *end;
+	LiteralNode *nodes;
+	char *chars;
+	size_t node_count = 0;
+	size_t char_count = 0;
+
+	constexpr LiteralParser( const char *b, const char *e, LiteralNode *n, char *c ) : ptr( b ), end( e ), nodes( n ), chars( c ) {}
+
+	static constexpr bool IsDigit( char c ) { return c >= '0' && c <= '9'; }
+
+	constexpr void SkipWhitespaceAndComments()
+	{
+		while ( ptr < end )
+		{
+			if ( *ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r' )
+			{
+				++ptr;
+			}
+			else if ( *ptr == '/' && ptr+1 < end && ptr[1] == '/' )
+			{
+				while ( ptr < end && *ptr != '\n' && *ptr != '\r' )
+					++ptr;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	// Skip whitespace and check that we are not at EOF
+	constexpr bool SkipToToken()
+	{
+		SkipWhitespaceAndComments();
+		return ptr < end || LiteralSyntaxError( "Unexpected end-of-input" );
+	}
+
+	constexpr LiteralNode *NewNode( EValueType type )
+	{
+		LiteralNode *n = nodes ? nodes + node_count : nullptr;
+		++node_count;
+		if ( n )
+			n->type = type;
+		return n;
+	}
+
+	constexpr void StoreChar( char c )
+	{
+		if ( chars )
+			chars[ char_count ] = c;
+		++char_count;
+	}
+
+	constexpr int HexDigit( char c )
+	{
+		if ( '0' <= c && c <= '9' ) return c - '0';
+		if ( 'a' <= c && c <= 'f' ) return c - 'a' + 0xa;
+		if ( 'A' <= c && c <= 'F' ) return c - 'A' + 0xa;
+		LiteralSyntaxError( "Invalid hex digit in \\u escape sequence" );
+		return -1;
+	}
+
+	constexpr bool ParseQuotedString()
+	{
+		++ptr; // opening quote
+		LiteralNode *n = NewNode( kString );
+		size_t start = char_count;
+		for (;;)
+		{
+			if ( ptr >= end )
+				return LiteralSyntaxError( "Unterminated string" );
+			char c = *(ptr++);
+			if ( c == '\"' )
+				break;
+			if ( (unsigned char)c < 0x20 )
+				return LiteralSyntaxError( "Control character in string. (Missing closing quote?)" );
+			if ( c != '\\' )
+			{
+				StoreChar( c );
+				continue;
+			}
+			if ( ptr >= end )
+				return LiteralSyntaxError( "Unterminated string" );
+			switch ( *(ptr++) )
+			{
+				case '\"': StoreChar( '\"' ); break;
+				case '\\': StoreChar( '\\' ); break;
+				case '/': StoreChar( '/' ); break;
+				case 'b': StoreChar( '\b' ); break;
+				case 'f': StoreChar( '\f' ); break;
+				case 'n': StoreChar( '\n' ); break;
+				case 'r': StoreChar( '\r' ); break;
+				case 't': StoreChar( '\t' ); break;
+				case 'u':
+				{
+					if ( ptr + 4 > end )
+						return LiteralSyntaxError( "End of input during \\u escape sequence" );
+					unsigned x = 0;
+					for ( int i = 0 ; i < 4 ; ++i )
+					{
+						int d = HexDigit( *(ptr++) );
+						if ( d < 0 )
+							return false;
+						x = ( x << 4 ) + (unsigned)d;
+					}
+					if ( x <= 0x7F )
+					{
+						StoreChar( (char)x );
+					}
+					else if ( x <= 0x7FF )
+					{
+						StoreChar( (char)( (x >> 6) | 0xC0 ) );
+						StoreChar( (char)( (x & 0x3F) | 0x80 ) );
+					}
+					else
+					{
+						StoreChar( (char)( (x >> 12) | 0xE0 ) );
+						StoreChar( (char)( ((x >> 6) & 0x3F) | 0x80 ) );
+						StoreChar( (char)( (x & 0x3F) | 0x80 ) );
+					}
+				} break;
+
+				default:
+					return LiteralSyntaxError( "Invalid escape sequence in string" );
+			}
+		}
+		if ( n )
+		{
+			n->offset = start;
+			n->len = char_count - start;
+		}
+		StoreChar( '\0' );
+		return true;
+	}
+
+	constexpr bool ParseNumber()
+	{
+		bool negative = false;
+		if ( *ptr == '-' )
+		{
+			negative = true;
+			++ptr;
+		}
+		if ( ptr >= end || !IsDigit( *ptr ) )
+			return LiteralSyntaxError( "Expected digit in JSON number" );
+
+		// Accumulate up to 19 significant digits into an integer mantissa,
+		// and keep track of the decimal exponent.
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		if ( *ptr == '0' )
+		{
+			++ptr;
+			if ( ptr < end && IsDigit( *ptr ) )
+				return LiteralSyntaxError( "Leading zeros / octal format not allowed in JSON number" );
+		}
+		while ( ptr < end && IsDigit( *ptr ) )
+		{
+			if ( mantissa < 1000000000000000000ULL )
+				mantissa = mantissa*10 + uint64_t( *ptr - '0' );
+			else
+				++exponent;
+			++ptr;
+		}
+		if ( ptr < end && *ptr == '.' )
+		{
+			++ptr;
+			if ( ptr >= end || !IsDigit( *ptr ) )
+				return LiteralSyntaxError( "Expected digit after '.' in JSON number" );
+			while ( ptr < end && IsDigit( *ptr ) )
+			{
+				if ( mantissa < 1000000000000000000ULL )
+				{
+					mantissa = mantissa*10 + uint64_t( *ptr - '0' );
+					--exponent;
+				}
+				++ptr;
+			}
+		}
+		if ( ptr < end && ( *ptr == 'e' || *ptr == 'E' ) )
+		{
+			++ptr;
+			bool negative_exponent = false;
+			if ( ptr < end && ( *ptr == '-' || *ptr == '+' ) )
+				negative_exponent = *(ptr++) == '-';
+			if ( ptr >= end || !IsDigit( *ptr ) )
+				return LiteralSyntaxError( "Digit is required after exponent in JSON number" );
+			int e = 0;
+			while ( ptr < end && IsDigit( *ptr ) )
+			{
+				if ( e < 10000 )
+					e = e*10 + ( *ptr - '0' );
+				++ptr;
+			}
+			exponent += negative_exponent ? -e : e;
+		}
+
+		// Scale by the power of ten. Powers up to 1e22 are exact in a double,
+		// so if the mantissa fits in 53 bits and the exponent is in that range,
+		// the result is correctly rounded.
+		constexpr double kPow10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		double x = (double)mantissa;
+		if ( mantissa != 0 )
+		{
+			for ( ; exponent > 22 && x < 1e308 ; exponent -= 22 )
+				x *= kPow10[22];
+			for ( ; exponent < -22 && x > 0.0 ; exponent += 22 )
+				x /= kPow10[22];
+			if ( exponent > 22 )
+				exponent = 22;
+			if ( exponent >= 0 )
+				x *= kPow10[exponent];
+			else if ( exponent >= -22 )
+				x /= kPow10[-exponent];
+		}
+
+		LiteralNode *n = NewNode( kDouble );
+		if ( n )
+			n->number = negative ? -x : x;
+		return true;
+	}
+
+	// Check for a keyword such as "true"
+	constexpr bool MatchKeyword( const char *word )
+	{
+		const char *p = ptr;
+		for ( ; *word ; ++word, ++p )
+		{
+			if ( p >= end || *p != *word )
+				return false;
+		}
+		ptr = p;
+		return true;
+	}
+
+	// Second pass only: does the key at key_idx match one that came before
+	// it in the object at obj_idx? The runtime parser would keep the last
+	// one, but a literal is a flat list that can't drop the others, so we
+	// don't allow duplicates.
+	constexpr bool HasEarlierKey( size_t obj_idx, size_t key_idx ) const
+	{
+		const LiteralNode &key = nodes[ key_idx ];
+		for ( size_t k = obj_idx+1 ; k < key_idx ; k += 1 + nodes[k+1].size )
+		{
+			if ( nodes[k].len != key.len )
+				continue;
+			size_t j = 0;
+			while ( j < key.len && chars[ nodes[k].offset + j ] == chars[ key.offset + j ] )
+				++j;
+			if ( j == key.len )
+				return true;
+		}
+		return false;
+	}
+
+	constexpr bool ParseValue()
+	{
+		if ( !SkipToToken() )
+			return false;
+		char c = *ptr;
+		if ( c == '{' || c == '[' )
+		{
+			++ptr;
+			bool is_object = ( c == '{' );
+			char close = is_object ? '}' : ']';
+			size_t idx = node_count;
+			NewNode( is_object ? kObject : kArray );
+			size_t len = 0;
+			for (;;)
+			{
+				if ( !SkipToToken() )
+					return false;
+				if ( *ptr == close )
+				{
+					++ptr;
+					break;
+				}
+				if ( len > 0 )
+				{
+					if ( *ptr != ',' )
+						return LiteralSyntaxError( is_object ? "Expected '}' or ','" : "Expected ']' or ','" );
+					++ptr;
+					if ( !SkipToToken() )
+						return false;
+					if ( *ptr == close ) // Trailing comma
+					{
+						++ptr;
+						break;
+					}
+				}
+				if ( is_object )
+				{
+					if ( *ptr != '\"' )
+						return LiteralSyntaxError( "Expected '\"' to begin JSON object key" );
+					size_t key_idx = node_count;
+					if ( !ParseQuotedString() || !SkipToToken() )
+						return false;
+					if ( nodes && HasEarlierKey( idx, key_idx ) )
+						return LiteralSyntaxError( "Duplicate key in JSON object" );
+					if ( *ptr != ':' )
+						return LiteralSyntaxError( "Expected ':'" );
+					++ptr;
+				}
+				if ( !ParseValue() )
+					return false;
+				++len;
+			}
+			if ( nodes )
+			{
+				nodes[idx].len = len;
+				nodes[idx].size = node_count - idx;
+			}
+			return true;
+		}
+		if ( c == '\"' )
+			return ParseQuotedString();
+		if ( c == '-' || IsDigit( c ) )
+			return ParseNumber();
+		if ( MatchKeyword( "true" ) )
+		{
+			LiteralNode *n = NewNode( kBool );
+			if ( n )
+				n->len = 1;
+			return true;
+		}
+		if ( MatchKeyword( "false" ) )
+		{
+			NewNode( kBool );
+			return true;
+		}
+		if ( MatchKeyword( "null" ) )
+		{
+			NewNode( kNull );
+			return true;
+		}
+		return LiteralSyntaxError( "Input is not a valid JSON value" );
+	}
+
+	constexpr bool ParseDocument()
+	{
+		// Trim off trailing '\0's, just like Value::ParseJSON
+		while ( end > ptr && end[-1] == '\0' )
+			--end;
+		if ( !ParseValue() )
+			return false;
+		SkipWhitespaceAndComments();
+		return ptr == end || LiteralSyntaxError( "Extra text after JSON value" );
+	}
+};
+
+struct LiteralSize { size_t nodes; size_t chars; };
+
+// First pass: validate the literal and measure how much space it needs
+template <size_t N>
+constexpr LiteralSize MeasureLiteral( const char (&text)[N] )
+{
+	LiteralParser p( text, text + N, nullptr, nullptr );
+	p.ParseDocument();
+	return LiteralSize{ p.node_count, p.char_count + 1 }; // +1 so we never have an empty array
+}
+
+// Storage for a compile-time document. Use VJSON_LITERAL to declare these.
+template <size_t kNodes, size_t kChars>
+struct LiteralDocument
+{
+	LiteralNode nodes[ kNodes ];
+	char chars[ kChars ];
+
+	constexpr LiteralDocument( const char *text, size_t len ) : nodes{}, chars{}
+	{
+		LiteralParser p( text, text + len, nodes, chars );
+		p.ParseDocument();
+	}
+
+	constexpr LiteralValue Root() const { return LiteralValue( nodes, chars ); }
+};
+
+#endif // #if VJSON_HAVE_CPP14
 
 } // namespace vjson
 